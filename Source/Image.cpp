@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "SipYAML.hpp"
+using std::cout;
+using std::endl;
+
+#ifdef SIPYAML_MMAP
+typedef std::chrono::steady_clock Clock;
+
+const char *sourcePath = "Image.yaml";
+const char *imagePath = "Image.img";
+
+long long microseconds(Clock::time_point start, Clock::time_point end)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		end - start).count();
+}
+
+/*!
+ *	Returns whether two trees have the same nodes, walking them through
+ *	every link. Image nodes walk their siblings for previousSibling(), so it
+ *	is only checked on the last one.
+**/
+template <typename A, typename B> bool same(const A *a, const B *b)
+{
+	const A *previousA = nullptr;
+	const B *previousB = nullptr;
+	for (; a && b; previousA = a, previousB = b, a = a->nextSibling(),
+		b = b->nextSibling())
+	{
+		if (a->type() != b->type() || a->keySize() != b->keySize() ||
+			a->valueSize() != b->valueSize() || !a->key() != !b->key() ||
+			!a->value() != !b->value() ||
+			(a->key() && !std::equal(a->key(), a->key() + a->keySize(),
+			b->key())) || (a->value() && !std::equal(a->value(),
+			a->value() + a->valueSize(), b->value())) ||
+			(!a->nextSibling() && (a->previousSibling() != previousA ||
+			b->previousSibling() != previousB)) ||
+			!a->firstChild() != !b->firstChild() ||
+			(b->firstChild() && b->lastChild()->nextSibling()) ||
+			!same(a->firstChild(), b->firstChild()))
+		{
+			return false;
+		}
+	}
+	return !a && !b;
+}
+
+int main()
+{
+	std::string yaml;
+	for (size_t i = 0; i != 400000; ++i)
+	{
+		yaml += "key" + std::to_string(i) + ": some value text # note\n"
+			"  - item: value number " + std::to_string(i) + "\n";
+	}
+	Sip::File::write(sourcePath, yaml);
+	remove(imagePath);
+
+	// The first open parses the source and writes the image.
+	bool passed;
+	{
+		Sip::YAMLImageUTF8 image;
+		passed = image.open(sourcePath, imagePath) && !image.isMapped();
+	}
+
+	long long parse = -1, open = -1;
+	for (size_t run = 0; run != 10; ++run)
+	{
+		Clock::time_point start = Clock::now();
+		{
+			std::vector<char> text;
+			Sip::File::read(sourcePath, &text);
+			Sip::YAMLDocumentUTF8 doc;
+			doc.parse(text.data());
+		}
+		Clock::time_point middle = Clock::now();
+		{
+			Sip::YAMLImageUTF8 image;
+			passed = image.open(sourcePath, imagePath) && image.isMapped() &&
+				passed;
+		}
+		Clock::time_point end = Clock::now();
+		long long first = microseconds(start, middle);
+		long long second = microseconds(middle, end);
+		parse = parse < 0 ? first : std::min(parse, first);
+		open = open < 0 ? second : std::min(open, second);
+	}
+
+	std::vector<char> text;
+	Sip::File::read(sourcePath, &text);
+	Sip::YAMLDocumentUTF8 doc;
+	doc.parse(text.data());
+	Sip::YAMLImageUTF8 image;
+	image.load(imagePath);
+	passed = same(doc.firstChild(), image.firstChild()) && passed;
+	uint64_t imageSize = 0;
+	int64_t time;
+	Sip::File::status(imagePath, &imageSize, &time);
+
+	cout << yaml.size() / 1000000.0 << " MB source, " << imageSize / 1000000.0 <<
+		" MB image: parse " << parse << " us, open " << open << " us" << endl;
+	remove(sourcePath);
+	remove(imagePath);
+	cout << (passed ? "PASSED" : "FAILED") << endl;
+	return passed ? 0 : 1;
+}
+#else
+int main()
+{
+	cout << "Document images need SIPYAML_MMAP." << endl;
+	return 0;
+}
+#endif // SIPYAML_MMAP
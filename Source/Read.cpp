@@ -18,10 +18,12 @@ void indent(size_t amount)
 	}
 }
 
-void showYAMLValue(Sip::YAMLDocumentUTF8::Node *node, size_t amount = 0)
+void showYAMLValue(const Sip::NodeBase<Sip::YAMLDocumentUTF8::Node> *root)
 {
-	while (node)
+	Sip::PreOrderIterator<Sip::YAMLDocumentUTF8::Node> node(root), end;
+	for (; node != end; ++node)
 	{
+		size_t amount = node.depth();
 		indent(amount);
 		cout << "Node: ";
 		switch (node->type() & 0xF)
@@ -50,11 +52,6 @@ void showYAMLValue(Sip::YAMLDocumentUTF8::Node *node, size_t amount = 0)
 			cout.write(node->value(), node->valueSize());
 			cout << "\"" << endl;
 		}
-		if (node->firstChild())
-		{
-			showYAMLValue(node->firstChild(), amount + 1);
-		}
-		node = node->nextSibling();
 	}
 }
 
@@ -63,7 +60,7 @@ int main()
 	Sip::YAMLDocumentUTF8 doc1;
 	doc1.parse(source);
 	cout << "Iterating through keys: " << endl;
-	showYAMLValue(doc1.firstChild());
+	showYAMLValue(&doc1);
 	
 	Sip::YAMLDocumentUTF16 doc2;
 	
@@ -24,8 +24,21 @@
 #include <memory>
 #include <cassert>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
+#include <iterator>
+#include <locale>
+#include <sstream>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
 
 #include <stack>
 using std::stack;
@@ -57,6 +70,16 @@ using std::cout;
 #elif (SIPYAML_DYNAMIC_POOL_SIZE < 128)
 #error "SIPYAML_DYNAMIC_POOL_SIZE must be greater than the node size."
 #endif // SIPYAML_DYNAMIC_POOL_SIZE
+/*!
+ *	Define this macro before including this header file to set the size of the
+ *	blocks that strings copied into a document are stored in. This size is in
+ *	bytes. Longer strings are given a block of their own.
+**/
+#ifndef SIPYAML_STRING_POOL_SIZE
+#define SIPYAML_STRING_POOL_SIZE 4096
+#elif (SIPYAML_STRING_POOL_SIZE < 16)
+#error "SIPYAML_STRING_POOL_SIZE must be at least 16."
+#endif // SIPYAML_STRING_POOL_SIZE
 
 // Check GCC flag.
 #ifdef __BYTEORDER__
@@ -70,6 +93,40 @@ using std::cout;
 #endif
 #endif // __BYTEORDER__
 
+// Check POSIX flag.
+#if defined(__unix__) || defined(__APPLE__)
+#ifndef SIPYAML_NO_MMAP
+/*!
+ *	Defined when document images can be memory mapped. Define SIPYAML_NO_MMAP
+ *	before including this header file to disable memory mapping.
+**/
+#define SIPYAML_MMAP
+#endif // SIPYAML_NO_MMAP
+#endif // POSIX
+
+#ifndef SIPYAML_NO_THREADS
+/*!
+ *	Defined when features that use threads are available. Define
+ *	SIPYAML_NO_THREADS before including this header file to disable them.
+**/
+#define SIPYAML_THREADS
+#endif // SIPYAML_NO_THREADS
+
+#ifdef SIPYAML_THREADS
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif // SIPYAML_THREADS
+
+#ifdef SIPYAML_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // SIPYAML_MMAP
+
 namespace Sip
 {
 	// Generic internal functions.
@@ -160,6 +217,44 @@ o		 *	Returns the BOM type of the indicated string. The string must be at
 			return UTF8;
 		}
 
+		/*!
+		 *	Returns the offset of the first character in the indicated UTF-16
+		 *	data that is not part of a valid surrogate pair, or size if all of
+		 *	it is valid. If swap is true, the data uses the opposite endian
+		 *	order to the system.
+		**/
+		inline size_t validateUTF16(const int16_t *data, size_t size,
+			bool swap)
+		{
+			for (size_t i = 0; i != size; ++i)
+			{
+				uint16_t unit = static_cast<uint16_t>(data[i]);
+				if (swap)
+				{
+					unit = static_cast<uint16_t>((unit << 8) | (unit >> 8));
+				}
+				if ((unit & 0xF800) != 0xD800)
+				{
+					continue;
+				}
+				if (unit & 0x0400 || i + 1 == size)
+				{
+					return i;
+				}
+				uint16_t next = static_cast<uint16_t>(data[i + 1]);
+				if (swap)
+				{
+					next = static_cast<uint16_t>((next << 8) | (next >> 8));
+				}
+				if ((next & 0xFC00) != 0xDC00)
+				{
+					return i;
+				}
+				++i;
+			}
+			return size;
+		}
+
 		/*!
 o		 *	Handles UTF-8 data comparison and escaping.
 		**/
@@ -170,6 +265,98 @@ o		 *	Handles UTF-8 data comparison and escaping.
 			{
 				return type == ch;
 			}
+
+			/*!
+			 *	Returns the offset of the first byte that does not start a
+			 *	valid UTF-8 sequence, or size if all of the data is valid.
+			 *	Overlong forms, surrogates and code points above U+10FFFF are
+			 *	not valid. ASCII is skipped 32 bytes at a time, and up to the
+			 *	first high bit of a word on little endian targets.
+			**/
+			static size_t validate(const CharType *data, size_t size)
+			{
+				const unsigned char *byte =
+					reinterpret_cast<const unsigned char*>(data);
+				const uint64_t high = 0x8080808080808080ULL;
+				size_t i = 0;
+				while (i != size)
+				{
+					uint64_t words[4];
+					while (size - i >= 32)
+					{
+						memcpy(words, byte + i, 32);
+						if ((words[0] | words[1] | words[2] | words[3]) & high)
+						{
+							break;
+						}
+						i += 32;
+					}
+					if (i == size)
+					{
+						break;
+					}
+					if (size - i >= 8)
+					{
+						uint64_t word;
+						memcpy(&word, byte + i, 8);
+						word &= high;
+						if (!word)
+						{
+							i += 8;
+							continue;
+						}
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && \
+	__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+						i += __builtin_ctzll(word) / 8;
+#endif
+					}
+					unsigned char lead = byte[i];
+					if (lead < 0x80)
+					{
+						++i;
+						continue;
+					}
+
+					// The second byte range excludes the invalid forms.
+					size_t length;
+					unsigned char low = 0x80;
+					unsigned char high = 0xBF;
+					if (lead >= 0xC2 && lead <= 0xDF)
+					{
+						length = 2;
+					}
+					else if (lead >= 0xE0 && lead <= 0xEF)
+					{
+						length = 3;
+						low = lead == 0xE0 ? 0xA0 : 0x80;
+						high = lead == 0xED ? 0x9F : 0xBF;
+					}
+					else if (lead >= 0xF0 && lead <= 0xF4)
+					{
+						length = 4;
+						low = lead == 0xF0 ? 0x90 : 0x80;
+						high = lead == 0xF4 ? 0x8F : 0xBF;
+					}
+					else
+					{
+						return i;
+					}
+					if (size - i < length || byte[i + 1] < low ||
+						byte[i + 1] > high)
+					{
+						return i;
+					}
+					for (size_t j = 2; j != length; ++j)
+					{
+						if ((byte[i + j] & 0xC0) != 0x80)
+						{
+							return i;
+						}
+					}
+					i += length;
+				}
+				return size;
+			}
 		};
 
 		/*!
@@ -183,6 +370,11 @@ o		 *	Handles UTF-8 data comparison and escaping.
 			{
 				return type == ch;
 			}
+
+			static inline size_t validate(const CharType *data, size_t size)
+			{
+				return validateUTF16(data, size, false);
+			}
 		};
 
 		/*!
@@ -196,7 +388,327 @@ o		 *	Handles UTF-8 data comparison and escaping.
 			{
 				return (type & 0xFF) == ch && (type & 0xFF00) == 0;
 			}
+
+			static inline size_t validate(const CharType *data, size_t size)
+			{
+				return validateUTF16(data, size, true);
+			}
+		};
+
+		/*!
+		 *	A string that is not null terminated.
+		**/
+		template <typename CharType> struct String
+		{
+			const CharType *data;
+			size_t size;
+		};
+
+		/*!
+		 *	Returns the string without the spaces around it. A string without
+		 *	data stays without data and has a size of 0.
+		**/
+		template <typename Char> String<typename Char::CharType> trim(
+			const typename Char::CharType *data, size_t size)
+		{
+			String<typename Char::CharType> string = {data, data ? size : 0};
+			while (string.size && Char::isChar(string.data[0], ' '))
+			{
+				++string.data;
+				--string.size;
+			}
+			while (string.size && Char::isChar(string.data[string.size - 1],
+				' '))
+			{
+				--string.size;
+			}
+			return string;
+		}
+	}
+
+	// Generic hashing functions.
+	namespace Hash
+	{
+		/*!
+		 *	Returns the 64-bit FNV-1a hash of the indicated bytes, continuing
+		 *	from the indicated hash.
+		**/
+		inline uint64_t bytes(const void *data, size_t size,
+			uint64_t hash = 0xCBF29CE484222325ULL)
+		{
+			const unsigned char *byte = static_cast<const unsigned char*>(data);
+			for (size_t i = 0; i != size; ++i)
+			{
+				hash ^= byte[i];
+				hash *= 0x100000001B3ULL;
+			}
+			return hash;
+		}
+
+		/*!
+		 *	Returns a 64-bit hash of the indicated bytes, continuing from the
+		 *	indicated hash. It reads eight bytes at a time, so it is several
+		 *	times faster than bytes() on large inputs, but gives other values.
+		**/
+		inline uint64_t words(const void *data, size_t size,
+			uint64_t hash = 0xCBF29CE484222325ULL)
+		{
+			const char *byte = static_cast<const char*>(data);
+			size_t i = 0;
+			for (; size - i >= 8; i += 8)
+			{
+				uint64_t word;
+				memcpy(&word, byte + i, 8);
+				hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+				hash ^= hash >> 29;
+			}
+			return bytes(byte + i, size - i, hash);
+		}
+
+		/*!
+		 *	Mixes a value into a hash. The order of values matters.
+		**/
+		inline uint64_t combine(uint64_t hash, uint64_t value)
+		{
+			return hash ^ (value + 0x9E3779B97F4A7C15ULL + (hash << 6) +
+				(hash >> 2));
+		}
+
+		/*!
+		 *	Hashes a string by its characters, for unordered containers.
+		**/
+		template <typename CharType> struct StringHash
+		{
+			size_t operator()(const Unicode::String<CharType> &string) const
+			{
+				return static_cast<size_t>(bytes(string.data,
+					string.size * sizeof(CharType)));
+			}
 		};
+
+		/*!
+		 *	Compares strings by their characters, for unordered containers.
+		**/
+		template <typename CharType> struct StringEqual
+		{
+			bool operator()(const Unicode::String<CharType> &a,
+				const Unicode::String<CharType> &b) const
+			{
+				return a.size == b.size && (!a.size ||
+					!memcmp(a.data, b.data, a.size * sizeof(CharType)));
+			}
+		};
+	}
+
+	namespace Number
+	{
+		/*!
+		 *	Reads up to limit decimal digits onto value, returning how many
+		 *	were read. On little endian targets, runs of eight digits are
+		 *	checked and combined a word at a time.
+		**/
+		inline size_t digits(const char *text, size_t size, size_t limit,
+			uint64_t *value)
+		{
+			size = size < limit ? size : limit;
+			uint64_t result = *value;
+			size_t i = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			while (size - i >= 8)
+			{
+				uint64_t word;
+				memcpy(&word, text + i, 8);
+				if ((word & 0xF0F0F0F0F0F0F0F0ULL) != 0x3030303030303030ULL ||
+					((word + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) !=
+					0x3030303030303030ULL)
+				{
+					break;
+				}
+				word -= 0x3030303030303030ULL;
+				word = word * 10 + (word >> 8);
+				word = ((word & 0x000000FF000000FFULL) *
+					(100 + (1000000ULL << 32)) +
+					((word >> 16) & 0x000000FF000000FFULL) *
+					(1 + (10000ULL << 32))) >> 32;
+				result = result * 100000000 + word;
+				i += 8;
+			}
+#endif
+			for (; i != size && text[i] >= '0' && text[i] <= '9'; ++i)
+			{
+				result = result * 10 + (text[i] - '0');
+			}
+			*value = result;
+			return i;
+		}
+
+		/*!
+		 *	Parses a decimal integer with an optional sign. Returns false if
+		 *	the text is not entirely an integer or does not fit in 64 bits.
+		**/
+		inline bool parseInteger(const char *text, size_t size, int64_t *value)
+		{
+			size_t i = 0;
+			bool negative = size && text[0] == '-';
+			if (size && (text[0] == '-' || text[0] == '+'))
+			{
+				++i;
+			}
+			size_t zeros = 0;
+			while (i + zeros != size && text[i + zeros] == '0')
+			{
+				++zeros;
+			}
+			i += zeros;
+			uint64_t magnitude = 0;
+			size_t count = digits(text + i, size - i, 20, &magnitude);
+			if (!(zeros + count) || i + count != size || count > 19 ||
+				magnitude > 0x7FFFFFFFFFFFFFFFULL + negative)
+			{
+				return false;
+			}
+			*value = negative ? static_cast<int64_t>(0 - magnitude) :
+				static_cast<int64_t>(magnitude);
+			return true;
+		}
+
+		/*!
+		 *	Returns whether the text is entirely a decimal number: an optional
+		 *	sign, digits with an optional fraction, and an optional exponent.
+		 *	Blanks, hexadecimal, infinity and NaN are not numbers.
+		**/
+		inline bool isReal(const char *text, size_t size)
+		{
+			size_t i = size && (text[0] == '-' || text[0] == '+');
+			size_t count = 0;
+			for (; i != size && text[i] >= '0' && text[i] <= '9'; ++i)
+			{
+				++count;
+			}
+			if (i != size && text[i] == '.')
+			{
+				for (++i; i != size && text[i] >= '0' && text[i] <= '9'; ++i)
+				{
+					++count;
+				}
+			}
+			if (!count)
+			{
+				return false;
+			}
+			if (i != size && (text[i] == 'e' || text[i] == 'E'))
+			{
+				++i;
+				if (i != size && (text[i] == '-' || text[i] == '+'))
+				{
+					++i;
+				}
+				if (i == size)
+				{
+					return false;
+				}
+				while (i != size && text[i] >= '0' && text[i] <= '9')
+				{
+					++i;
+				}
+			}
+			return i == size;
+		}
+
+		/*!
+		 *	Parses a decimal number with an optional sign, fraction and
+		 *	exponent, independent of the current locale. Numbers whose digits
+		 *	fit in 53 bits and whose exponent is small are converted exactly
+		 *	here, and others with std::from_chars() where the library has it,
+		 *	or else with a stream in the classic locale that each thread
+		 *	keeps. Returns false if the text is not entirely a number, see
+		 *	isReal(), or does not fit in a double.
+		**/
+		inline bool parseReal(const char *text, size_t size, double *value)
+		{
+			static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5,
+				1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16,
+				1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+			if (!isReal(text, size))
+			{
+				return false;
+			}
+			size_t i = 0;
+			bool negative = text[0] == '-';
+			if (text[0] == '-' || text[0] == '+')
+			{
+				++i;
+			}
+			uint64_t mantissa = 0;
+			size_t whole = digits(text + i, size - i, 19, &mantissa);
+			i += whole;
+			size_t fraction = 0;
+			if (i != size && text[i] == '.')
+			{
+				++i;
+				fraction = digits(text + i, size - i, 19 - whole, &mantissa);
+				i += fraction;
+			}
+			int64_t exponent = 0;
+			if (whole + fraction && i != size && (text[i] == 'e' ||
+				text[i] == 'E'))
+			{
+				size_t start = ++i;
+				bool below = i != size && text[i] == '-';
+				if (i != size && (text[i] == '-' || text[i] == '+'))
+				{
+					++i;
+				}
+				uint64_t power = 0;
+				size_t count = digits(text + i, size - i, 4, &power);
+				exponent = below ? -static_cast<int64_t>(power) :
+					static_cast<int64_t>(power);
+				i = count ? i + count : start - 1;
+			}
+			exponent -= static_cast<int64_t>(fraction);
+
+			if (whole + fraction && i == size && mantissa <= (1ULL << 53) &&
+				exponent >= -22 && exponent <= 22)
+			{
+				double result = static_cast<double>(mantissa);
+				result = exponent < 0 ? result / powers[-exponent] :
+					result * powers[exponent];
+				*value = negative ? -result : result;
+				return true;
+			}
+
+			// Too many digits or a large exponent.
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+			i = text[0] == '+';
+			double result;
+			std::from_chars_result read = std::from_chars(text + i,
+				text + size, result);
+			if (read.ec != std::errc() || read.ptr != text + size)
+			{
+				return false;
+			}
+			*value = result;
+			return true;
+#else
+			static thread_local std::istringstream stream;
+			static thread_local bool classic = false;
+			if (!classic)
+			{
+				stream.imbue(std::locale::classic());
+				classic = true;
+			}
+			stream.clear();
+			stream.str(std::string(text, size));
+			double result;
+			stream >> result;
+			if (stream.fail())
+			{
+				return false;
+			}
+			*value = result;
+			return true;
+#endif
+		}
 	}
 
 	/*!
@@ -226,578 +738,4828 @@ o		 *	Handles UTF-8 data comparison and escaping.
 	 *	A generic node class that stores other nodes as children and siblings in
 	 *	a linked list type format.
 	**/
-	template <typename NodeType> struct NodeBase
+	template <typename NodeType> struct FullLinks;
+	template <typename Char, template <typename> class Links = FullLinks>
+		struct YAMLDiff;
+	template <typename Char, template <typename> class Links = FullLinks>
+		struct YAMLNode;
+	template <typename Char, template <typename> class Links = FullLinks>
+		struct YAMLDocumentBase;
+	template <typename NodeType> struct NodeBase;
+
+	/*!
+	 *	A forward iterator over the children of a node.
+	**/
+	template <typename NodeType> struct ChildIterator
 	{
+		typedef std::forward_iterator_tag iterator_category;
+		typedef NodeType value_type;
+		typedef ptrdiff_t difference_type;
+		typedef NodeType *pointer;
+		typedef NodeType &reference;
+
 		/*!
-		 *	Adds a node at the end. The node must not be attached to any other
-		 *	nodes before inserting.
+		 *	Creates an iterator pointing at the indicated node, or the end
+		 *	iterator if it is 0.
 		**/
-		void appendNode(NodeType *node)
+		explicit ChildIterator(NodeType *node = nullptr) : _node(node) {}
+
+		inline NodeType &operator*() const
 		{
-			assert(node && !node->_parent &&
-				!node->_nextSibling && !node->_previousSibling);
-			node->_parent = static_cast<NodeType*>(this);
-			node->_nextSibling = nullptr;
-			if (_firstChild)
-			{
-				_lastChild->_nextSibling = node;
-				node->_previousSibling = _lastChild;
-			}
-			else
-			{
-				_firstChild = node;
-			}
-			_lastChild = node;
+			return *_node;
 		}
-		
-		/*!
-		 *	Returns this node's parent, or 0 if it does not have one.
-		**/
-		inline NodeType *parent() const
+
+		inline NodeType *operator->() const
 		{
-			return _parent;
+			return _node;
 		}
-		
-		/*!
-		 *	Returns this node's next sibling, or 0 if it does not have one.
-		**/
-		inline NodeType *nextSibling() const
+
+		inline ChildIterator &operator++()
 		{
-			return _nextSibling;
+			_node = _node->nextSibling();
+			return *this;
 		}
-		
-		/*!
-		 *	Returns this node's previous sibling, or 0 if it does not have one.
-		**/
-		inline NodeType *previousSibling() const
+
+		inline ChildIterator operator++(int)
 		{
-			return _previousSibling;
+			ChildIterator previous = *this;
+			++*this;
+			return previous;
 		}
-		
-		/*!
-		 *	Returns this node's first child, or 0 if it does not have one.
-		**/
-		inline NodeType *firstChild() const
+
+		inline bool operator==(const ChildIterator &other) const
 		{
-			return _firstChild;
+			return _node == other._node;
 		}
-		
-		/*!
-		 *	Returns this node's last child, or 0 if it does not have one.
-		**/
-		inline NodeType *lastChild() const
+
+		inline bool operator!=(const ChildIterator &other) const
 		{
-			return _lastChild;
+			return _node != other._node;
 		}
-	
-	protected:
-	
-		NodeBase() : _parent(nullptr), _nextSibling(nullptr),
-			_previousSibling(nullptr), _firstChild(nullptr),
-			_lastChild(nullptr) {}
-		
+
 	private:
-		NodeType *_parent;
-		NodeType *_nextSibling;
-		NodeType *_previousSibling;
-		NodeType *_firstChild;
-		NodeType *_lastChild;
+		NodeType *_node;
 	};
 
 	/*!
-	 *	A YAML node that has a type, a key and a value.
+	 *	A forward iterator over every node below a root, visiting each parent
+	 *	before its children. It follows parent links rather than keeping a
+	 *	stack, so the nesting depth is not limited.
 	**/
-	template <typename Char> struct YAMLNode :
-		public NodeBase<YAMLNode<Char>>
+	template <typename NodeType> struct PreOrderIterator
 	{
-		typedef typename Char::CharType CharType;
-		
+		typedef std::forward_iterator_tag iterator_category;
+		typedef NodeType value_type;
+		typedef ptrdiff_t difference_type;
+		typedef NodeType *pointer;
+		typedef NodeType &reference;
+
 		/*!
-		 *	Creates a node. The validity of key and value sizes is not checked.
+		 *	Creates an iterator pointing at the first child of the indicated
+		 *	root, or the end iterator if root is 0.
 		**/
-		YAMLNode(YAMLType type = Begin, const CharType *key = 0,
-			size_t keySize = 0, const CharType *value = 0,
-			size_t valueSize = 0) : NodeBase<YAMLNode<Char>>(),
-			_key(key), _value(value), _keySize(keySize), _valueSize(valueSize),
-			_type(type) {}
-		
-		/*!
-		 *	Returns the YAML type.
-		**/
-		inline YAMLType type() const
-		{
-			return _type;
-		}
-		
-		/*!
-		 *	Returns the key. This is not null terminated, so you must also use
-		 *	keySize() to compare key values. If this node does not have a key,
-		 *	0 is returned.
-		**/
-		inline const CharType *key() const
+		explicit PreOrderIterator(const NodeBase<NodeType> *root = nullptr) :
+			_root(root), _node(root ? root->firstChild() : nullptr),
+			_depth(0) {}
+
+		inline NodeType &operator*() const
 		{
-			return _key;
+			return *_node;
 		}
-		
-		/*!
-		 *	Returns the length of the key, in terms of CharType.
-		**/
-		inline size_t keySize() const
+
+		inline NodeType *operator->() const
 		{
-			return _keySize;
+			return _node;
 		}
-		
+
 		/*!
-		 *	Sets a key. The length of the key is determined by looking for a
-		 *	null terminated character.
+		 *	Returns the depth of the current node. Children of the root have a
+		 *	depth of 0.
 		**/
-		void setKey(const CharType *key)
+		inline size_t depth() const
 		{
-			_key = key;
-			_keySize = Unicode::datalen(key);
+			return _depth;
 		}
-		
-		/*!
-		 *	Sets the key and the key size. The validity of the indicated key
-		 *	size is not checked.
-		**/
-		void setKey(const CharType *key, size_t size)
+
+		inline PreOrderIterator &operator++()
 		{
-			_key = key;
-			_keySize = size;
+			if (_node->firstChild())
+			{
+				_node = _node->firstChild();
+				++_depth;
+			}
+			else
+			{
+				skipChildren();
+			}
+			return *this;
 		}
-		
-		/*!
-		 *	Returns the value. This is not null terminated, so you must also use
-		 *	valueSize() to compare values. If this node does not have a value,
-		 *	0 is returned.
-		**/
-		inline const CharType *value() const
+
+		inline PreOrderIterator operator++(int)
 		{
-			return _value;
+			PreOrderIterator previous = *this;
+			++*this;
+			return previous;
 		}
-		
+
 		/*!
-		 *	Returns the length of the value, in terms of CharType.
+		 *	Moves to the next node that is not a child of the current node.
 		**/
-		inline size_t valueSize() const
+		void skipChildren()
 		{
-			return _valueSize;
+			while (!_node->nextSibling())
+			{
+				_node = _node->parent();
+				if (!_node || _node == _root)
+				{
+					_node = nullptr;
+					return;
+				}
+				--_depth;
+			}
+			_node = _node->nextSibling();
 		}
-		
-		/*!
-		 *	Sets a value. The length of the value is determined by looking for a
-		 *	null terminated character.
-		**/
-		void setValue(const CharType *value)
+
+		inline bool operator==(const PreOrderIterator &other) const
 		{
-			_value = value;
-			_valueSize = Unicode::datalen(value);
+			return _node == other._node;
 		}
-		
-		/*!
-		 *	Sets the value and the value size. The validity of the indicated
-		 *	value size is not checked.
-		**/
-		void setValue(const CharType *value, size_t size)
+
+		inline bool operator!=(const PreOrderIterator &other) const
 		{
-			_value = value;
-			_valueSize = size;
+			return _node != other._node;
 		}
-		
-	protected:
-		const CharType *_key;
-		const CharType *_value;
-		size_t _keySize;
-		size_t _valueSize;
-		YAMLType _type;
+
+	private:
+		const NodeBase<NodeType> *_root;
+		NodeType *_node;
+		size_t _depth;
 	};
-	
-	namespace Print
+
+	/*!
+	 *	A forward iterator over every node below a root, visiting each parent
+	 *	after its children. Like PreOrderIterator, it needs no stack.
+	**/
+	template <typename NodeType> struct PostOrderIterator
 	{
-		template <typename Char> void printYAMLChildren(
-			std::string *printer, NodeBase<YAMLNode<Char>> *node,
-			size_t indent = 0);
-		
+		typedef std::forward_iterator_tag iterator_category;
+		typedef NodeType value_type;
+		typedef ptrdiff_t difference_type;
+		typedef NodeType *pointer;
+		typedef NodeType &reference;
+
 		/*!
-		 *	Prints a YAML mapping element.
+		 *	Creates an iterator pointing at the first leaf of the indicated
+		 *	root, or the end iterator if root is 0.
 		**/
-		template <typename Char> void printYAMLMap(std::string *printer,
-			YAMLNode<Char> *node, size_t indent = 0)
+		explicit PostOrderIterator(const NodeBase<NodeType> *root = nullptr) :
+			_root(root), _node(root ? root->firstChild() : nullptr),
+			_depth(0)
 		{
-			if (!printer->empty())
-			{
-				printer->append(1, '\n');
-			}
-			printer->append(indent, ' ');
-			printer->append(node->key(), node->keySize());
-			printer->append(": ");
-			if (node->value())
-			{
-				printer->append(node->value(), node->valueSize());
-			}
-			printYAMLChildren(printer, node, indent + 2);
+			descend();
 		}
-		
-		/*!
-		 *	Prints a YAML sequence element.
-		**/
-		template <typename Char> void printYAMLList(std::string *printer,
-			YAMLNode<Char> *node, size_t indent = 0)
+
+		inline NodeType &operator*() const
 		{
-			if (!printer->empty())
-			{
-				printer->append(1, '\n');
-			}
-			printer->append(indent, ' ');
-			printer->append("- ");
-			if (node->key())
-			{
-				printer->append(node->key(), node->keySize());
-				printer->append(": ");
-			}
-			printer->append(node->value(), node->valueSize());
-			printYAMLChildren(printer, node, indent + 2);
+			return *_node;
 		}
-		
+
+		inline NodeType *operator->() const
+		{
+			return _node;
+		}
+
 		/*!
-		 *	Prints a YAML comment.
+		 *	Returns the depth of the current node. Children of the root have a
+		 *	depth of 0.
 		**/
-		template <typename Char> void printYAMLComment(
-			std::string *printer, YAMLNode<Char> *node, size_t indent = 0)
+		inline size_t depth() const
 		{
-			if (node->type() & YAMLType::Flow)
+			return _depth;
+		}
+
+		inline PostOrderIterator &operator++()
+		{
+			if (_node->nextSibling())
 			{
-				printer->append(" # ");
+				_node = _node->nextSibling();
+				descend();
 			}
 			else
 			{
-				if (!printer->empty())
+				_node = _node->parent();
+				if (!_node || _node == _root)
 				{
-					printer->append(1, '\n');
+					_node = nullptr;
+				}
+				else
+				{
+					--_depth;
 				}
-				printer->append("# ");
 			}
-			printer->append(node->value(), node->valueSize());
+			return *this;
 		}
-		
-		/*!
-		 *	Prints the children of a YAML node.
-		**/
-		template <typename Char> void printYAMLChildren(
-			std::string *printer, NodeBase<YAMLNode<Char>> *node,
-			size_t indent = 0)
+
+		inline PostOrderIterator operator++(int)
+		{
+			PostOrderIterator previous = *this;
+			++*this;
+			return previous;
+		}
+
+		inline bool operator==(const PostOrderIterator &other) const
+		{
+			return _node == other._node;
+		}
+
+		inline bool operator!=(const PostOrderIterator &other) const
+		{
+			return _node != other._node;
+		}
+
+	private:
+		void descend()
 		{
-			YAMLNode<Char> *child = node->firstChild();
-			while (child)
+			while (_node && _node->firstChild())
 			{
-				switch (child->type() & 0xF)
-				{
-				case YAMLType::Begin:
-					printer->append("---");
-					break;
-				case YAMLType::End:
-					printer->append("...");
-					break;
-				case YAMLType::Mapping:
-					printYAMLMap(printer, child, indent);
-					break;
-				case YAMLType::Sequence:
-					printYAMLList(printer, child, indent);
-					break;
-				case YAMLType::Directive:
-					printer->append(1, '%');
-					printer->append(child->key(), child->keySize());
-					if (child->value())
-					{
-						printer->append(" ");
-						printer->append(child->value(), child->valueSize());
-					}
-					break;
-				}
-				child = child->nextSibling();
+				_node = _node->firstChild();
+				++_depth;
 			}
 		}
-	}
+
+		const NodeBase<NodeType> *_root;
+		NodeType *_node;
+		size_t _depth;
+	};
 
 	/*!
-	 *	A generic class that allocates data from a memory pool for a single node
-	 *	type. Data is preallocated in bytes, with the total number of bytes
-	 *	equalling the indicated StaticPoolSize as stack memory. When it runs out
-	 *	memory will begin to be placed on the heap whose size is indicated by
-	 *	DynamicPoolSize.
+	 *	A pair of iterators that can be used with range-based for loops.
 	**/
-	template <typename NodeType, size_t StaticPoolSize,
-			  size_t DynamicPoolSize> struct MemoryPool
+	template <typename Iterator> struct NodeRange
 	{
-		/*!
-		 *	Creates a memory pool.
-		**/
-		MemoryPool() : _memoryFirst(0),
-			_memoryPosition((char*)_memoryStatic),
-			_memoryEnd(_memoryPosition + StaticPoolSize) {}
-		
-		/*!
-		 *	Clears all internal data.
-		**/
-		~MemoryPool()
-		{
-			clear();
-		}
-		
-	protected:
-	
-		/*!
-		 *	Returns the next available free space, creating it if it does not
-		 *	exist.
-		**/
-		void *allocate()
+		NodeRange(Iterator first, Iterator last) : _begin(first),
+			_end(last) {}
+
+		inline Iterator begin() const
 		{
-			void *position = _memoryPosition;
-			if (_memoryPosition + sizeof(NodeType) > _memoryEnd)
-			{
-				_memoryPosition = new char[64];
-				memcpy(_memoryPosition, &_memoryFirst, sizeof(void*));
-				_memoryFirst = _memoryPosition;
-				_memoryEnd = _memoryPosition + 64;
-				position = _memoryPosition + sizeof(void*);
-			}
-			_memoryPosition += sizeof(NodeType);
-			return position;
+			return _begin;
 		}
-		
-		/*!
-		 *	Clears all stored dynamic memory blocks.
-		**/
-		void clear()
+
+		inline Iterator end() const
 		{
-			if (_memoryFirst)
-			{
-				void *location = _memoryFirst;
-				while (location)
-				{
-					memcpy(&location, _memoryFirst, sizeof(void*));
-					delete[] _memoryFirst;
-					_memoryFirst = static_cast<char*>(location);
-				}
-			}
+			return _end;
 		}
-		
+
 	private:
-		
-		char _memoryStatic[StaticPoolSize];
-		char *_memoryFirst;			// Current memory block first position.
-		char *_memoryPosition;		// Free memory position.
-		char *_memoryEnd;			// Memory not allowed to write.
+		Iterator _begin;
+		Iterator _end;
 	};
-	
+
 	/*!
-	 *	Represents a YAML document.
+	 *	A link set that stores every link, so all NodeBase operations take
+	 *	constant time. This is the default.
 	**/
-	template <typename Char> struct YAMLDocumentBase :
-		public MemoryPool<YAMLNode<Char>, SIPYAML_STATIC_POOL_SIZE,
-		SIPYAML_DYNAMIC_POOL_SIZE>, public NodeBase<YAMLNode<Char>>
+	template <typename NodeType> struct FullLinks
 	{
-		typedef typename Char::CharType CharType;
-		typedef YAMLNode<Char> Node;
-	
-		/*!
-		 *	Creates and returns a new YAML node. This node is automatically
-		 *	deleted when the document is deleted.
-		**/
-		YAMLNode<Char> *allocateNode(YAMLType type, const CharType *key = 0,
-			size_t keySize = 0, const CharType *value = 0, size_t valueSize = 0)
+		static const bool HasBackLinks = true;
+
+	protected:
+		FullLinks() : _parent(nullptr), _nextSibling(nullptr),
+			_firstChild(nullptr), _previousSibling(nullptr),
+			_lastChild(nullptr) {}
+
+		inline NodeType *previousLink() const
 		{
-			YAMLNode<Char> *node = new(this->allocate()) YAMLNode<Char>(type, 
-				key, keySize, value, valueSize);
-			return node;
+			return _previousSibling;
 		}
-		
-		/*!
-		 *	Prints a readable YAML file representation.
-		**/
-		void print(std::string *printer)
+
+		inline void setPreviousLink(NodeType *node)
 		{
-			Print::printYAMLChildren(printer, this);
+			_previousSibling = node;
 		}
-		
-		/*!
-		 *	Parses a YAML file.
-		**/
+
+		inline NodeType *lastLink() const
+		{
+			return _lastChild;
+		}
+
+		inline void setLastLink(NodeType *node)
+		{
+			_lastChild = node;
+		}
+
+		NodeType *_parent;
+		NodeType *_nextSibling;
+		NodeType *_firstChild;
+
+	private:
+		NodeType *_previousSibling;
+		NodeType *_lastChild;
+	};
+
+	/*!
+	 *	A link set that only stores the parent, the next sibling and the first
+	 *	child, which makes every node two pointers smaller. Walking forward
+	 *	and upward is as fast as with FullLinks, but previousSibling(),
+	 *	lastChild(), appendNode(), insertNode() and removeNode() have to walk
+	 *	the siblings. Use insertAfter() to add nodes in constant time. A
+	 *	read-only document can be made smaller still by writing it as a
+	 *	document image, which uses 32 bit relative links.
+	**/
+	template <typename NodeType> struct ForwardLinks
+	{
+		static const bool HasBackLinks = false;
+
+	protected:
+		ForwardLinks() : _parent(nullptr), _nextSibling(nullptr),
+			_firstChild(nullptr) {}
+
+		inline NodeType *previousLink() const
+		{
+			return nullptr;
+		}
+
+		inline void setPreviousLink(NodeType *) {}
+
+		inline NodeType *lastLink() const
+		{
+			return nullptr;
+		}
+
+		inline void setLastLink(NodeType *) {}
+
+		NodeType *_parent;
+		NodeType *_nextSibling;
+		NodeType *_firstChild;
+	};
+
+	/*!
+	 *	Selects the link set of a node type. Node types that take a link set
+	 *	as a template parameter specialize this, everything else uses
+	 *	FullLinks.
+	**/
+	template <typename NodeType> struct NodeLinks
+	{
+		typedef FullLinks<NodeType> Type;
+	};
+
+	template <typename Char, template <typename> class Links>
+		struct NodeLinks<YAMLNode<Char, Links>>
+	{
+		typedef Links<YAMLNode<Char, Links>> Type;
+	};
+
+	template <typename NodeType> struct NodeBase :
+		public NodeLinks<NodeType>::Type
+	{
+		typedef typename NodeLinks<NodeType>::Type Links;
+
+		/*!
+		 *	Adds a node at the end. The node must not be attached to any other
+		 *	nodes before inserting.
+		**/
+		void appendNode(NodeType *node)
+		{
+			insertAfter(lastChild(), node);
+		}
+
+		/*!
+		 *	Adds a node after the indicated child, or at the start if previous
+		 *	is 0. The node must not be attached to any other nodes before
+		 *	inserting. This takes constant time with any link set.
+		**/
+		void insertAfter(NodeType *previous, NodeType *node)
+		{
+			link(previous, node);
+			node->_inserted = true;
+			invalidate();
+		}
+
+		/*!
+		 *	Adds a node before the indicated child, or at the end if before is
+		 *	0. The node must not be attached to any other nodes before
+		 *	inserting.
+		**/
+		void insertNode(NodeType *node, NodeType *before)
+		{
+			assert(!before || before->_parent == static_cast<NodeType*>(this));
+			insertAfter(before ? before->previousSibling() : lastChild(), node);
+		}
+
+		/*!
+		 *	Detaches the indicated child. Its own children are kept.
+		**/
+		void removeNode(NodeType *node)
+		{
+			assert(node && node->_parent == static_cast<NodeType*>(this));
+			NodeType *previous = node->previousSibling();
+			if (previous)
+			{
+				previous->_nextSibling = node->_nextSibling;
+			}
+			else
+			{
+				this->_firstChild = node->_nextSibling;
+			}
+			if (node->_nextSibling)
+			{
+				node->_nextSibling->setPreviousLink(previous);
+			}
+			else
+			{
+				this->setLastLink(previous);
+			}
+			node->_parent = nullptr;
+			node->_nextSibling = nullptr;
+			node->setPreviousLink(nullptr);
+			invalidate();
+		}
+
+		/*!
+		 *	Returns true if this node or one of its children changed since it
+		 *	was parsed, or if it was not parsed at all.
+		**/
+		inline bool isDirty() const
+		{
+			return _dirty;
+		}
+
+		/*!
+		 *	Returns true if this node was added by appendNode(), insertAfter()
+		 *	or insertNode() rather than where it was parsed, so its source
+		 *	text may no longer fit around it.
+		**/
+		inline bool isInserted() const
+		{
+			return _inserted;
+		}
+		
+		/*!
+		 *	Returns this node's parent, or 0 if it does not have one.
+		**/
+		inline NodeType *parent() const
+		{
+			return this->_parent;
+		}
+		
+		/*!
+		 *	Returns this node's next sibling, or 0 if it does not have one.
+		**/
+		inline NodeType *nextSibling() const
+		{
+			return this->_nextSibling;
+		}
+		
+		/*!
+		 *	Returns this node's previous sibling, or 0 if it does not have one.
+		 *	Without back links, this walks from the parent's first child.
+		**/
+		inline NodeType *previousSibling() const
+		{
+			if (Links::HasBackLinks || !this->_parent)
+			{
+				return this->previousLink();
+			}
+			NodeType *node = this->_parent->_firstChild;
+			if (node == this)
+			{
+				return nullptr;
+			}
+			while (node->_nextSibling != this)
+			{
+				node = node->_nextSibling;
+			}
+			return node;
+		}
+		
+		/*!
+		 *	Returns this node's first child, or 0 if it does not have one.
+		**/
+		inline NodeType *firstChild() const
+		{
+			return this->_firstChild;
+		}
+		
+		/*!
+		 *	Returns this node's last child, or 0 if it does not have one.
+		 *	Without back links, this walks all children.
+		**/
+		inline NodeType *lastChild() const
+		{
+			if (Links::HasBackLinks || !this->_firstChild)
+			{
+				return this->lastLink();
+			}
+			NodeType *node = this->_firstChild;
+			while (node->_nextSibling)
+			{
+				node = node->_nextSibling;
+			}
+			return node;
+		}
+
+		/*!
+		 *	Returns a range over this node's children.
+		**/
+		inline NodeRange<ChildIterator<NodeType>> children() const
+		{
+			return NodeRange<ChildIterator<NodeType>>(
+				ChildIterator<NodeType>(this->_firstChild),
+				ChildIterator<NodeType>());
+		}
+
+		/*!
+		 *	Returns a range over every node below this one, parents first.
+		**/
+		inline NodeRange<PreOrderIterator<NodeType>> preOrder() const
+		{
+			return NodeRange<PreOrderIterator<NodeType>>(
+				PreOrderIterator<NodeType>(this), PreOrderIterator<NodeType>());
+		}
+
+		/*!
+		 *	Returns a range over every node below this one, children first.
+		**/
+		inline NodeRange<PostOrderIterator<NodeType>> postOrder() const
+		{
+			return NodeRange<PostOrderIterator<NodeType>>(
+				PostOrderIterator<NodeType>(this),
+				PostOrderIterator<NodeType>());
+		}
+	
+	protected:
+	
+		NodeBase() : _hash(0), _dirty(true), _inserted(false) {}
+
+		/*!
+		 *	Links a node after the indicated child, or at the start if previous
+		 *	is 0, without marking anything dirty. Cached hashes of this node
+		 *	and its parents are discarded.
+		**/
+		void link(NodeType *previous, NodeType *node)
+		{
+			for (NodeBase *parent = this; parent && parent->_hash;
+				parent = parent->_parent)
+			{
+				parent->_hash = 0;
+			}
+			assert(node && !node->_parent && !node->_nextSibling);
+			assert(!previous || previous->_parent == static_cast<NodeType*>(this));
+			node->_parent = static_cast<NodeType*>(this);
+			NodeType *next;
+			if (previous)
+			{
+				next = previous->_nextSibling;
+				previous->_nextSibling = node;
+			}
+			else
+			{
+				next = this->_firstChild;
+				this->_firstChild = node;
+			}
+			node->_nextSibling = next;
+			node->setPreviousLink(previous);
+			if (next)
+			{
+				next->setPreviousLink(node);
+			}
+			else
+			{
+				this->setLastLink(node);
+			}
+		}
+
+		/*!
+		 *	Forgets all children without modifying them.
+		**/
+		void clearChildren()
+		{
+			this->_firstChild = nullptr;
+			this->setLastLink(nullptr);
+			invalidate();
+		}
+
+		/*!
+		 *	Discards the cached hash of this node and its parents and marks
+		 *	them dirty. Parents of a node without a cached hash never have one,
+		 *	and parents of a dirty node are always dirty, so this stops early.
+		**/
+		void invalidate()
+		{
+			NodeBase *node = this;
+			while (node && (node->_hash || !node->_dirty))
+			{
+				node->_hash = 0;
+				node->_dirty = true;
+				node = node->_parent;
+			}
+		}
+		
+	private:
+		template <typename, template <typename> class> friend struct YAMLDiff;
+		template <typename, template <typename> class>
+			friend struct YAMLDocumentBase;
+
+		mutable uint64_t _hash;		// Cached subtree hash, or 0.
+		bool _dirty;				// Changed since parsing.
+		bool _inserted;				// Linked by an edit, not by parsing.
+	};
+
+	/*!
+	 *	A YAML node that has a type, a key and a value. Links selects which
+	 *	links the node stores; see FullLinks and ForwardLinks.
+	**/
+	template <typename Char, template <typename> class Links> struct YAMLNode :
+		public NodeBase<YAMLNode<Char, Links>>
+	{
+		typedef typename Char::CharType CharType;
+		
+		/*!
+		 *	Creates a node. The validity of key and value sizes is not checked.
+		**/
+		YAMLNode(YAMLType type = Begin, const CharType *key = 0,
+			size_t keySize = 0, const CharType *value = 0,
+			size_t valueSize = 0) : NodeBase<YAMLNode<Char, Links>>(),
+			_type(type), _modified(false), _key(key), _value(value), _line(0),
+			_keySize(keySize), _valueSize(valueSize), _lineSize(0) {}
+		
+		/*!
+		 *	Returns the YAML type.
+		**/
+		inline YAMLType type() const
+		{
+			return _type;
+		}
+		
+		/*!
+		 *	Returns the key. This is not null terminated, so you must also use
+		 *	keySize() to compare key values. If this node does not have a key,
+		 *	0 is returned.
+		**/
+		inline const CharType *key() const
+		{
+			return _key;
+		}
+		
+		/*!
+		 *	Returns the length of the key, in terms of CharType.
+		**/
+		inline size_t keySize() const
+		{
+			return _keySize;
+		}
+		
+		/*!
+		 *	Sets a key. The length of the key is determined by looking for a
+		 *	null terminated character.
+		**/
+		void setKey(const CharType *key)
+		{
+			_key = key;
+			_keySize = Unicode::datalen(key);
+			_modified = true;
+			this->invalidate();
+		}
+		
+		/*!
+		 *	Sets the key and the key size. The validity of the indicated key
+		 *	size is not checked.
+		**/
+		void setKey(const CharType *key, size_t size)
+		{
+			_key = key;
+			_keySize = size;
+			_modified = true;
+			this->invalidate();
+		}
+		
+		/*!
+		 *	Returns the value. This is not null terminated, so you must also use
+		 *	valueSize() to compare values. If this node does not have a value,
+		 *	0 is returned.
+		**/
+		inline const CharType *value() const
+		{
+			return _value;
+		}
+		
+		/*!
+		 *	Returns the length of the value, in terms of CharType.
+		**/
+		inline size_t valueSize() const
+		{
+			return _valueSize;
+		}
+		
+		/*!
+		 *	Sets a value. The length of the value is determined by looking for a
+		 *	null terminated character.
+		**/
+		void setValue(const CharType *value)
+		{
+			_value = value;
+			_valueSize = Unicode::datalen(value);
+			_modified = true;
+			this->invalidate();
+		}
+		
+		/*!
+		 *	Sets the value and the value size. The validity of the indicated
+		 *	value size is not checked.
+		**/
+		void setValue(const CharType *value, size_t size)
+		{
+			_value = value;
+			_valueSize = size;
+			_modified = true;
+			this->invalidate();
+		}
+
+		/*!
+		 *	Returns a hash of this node's type, key, value and children. It is
+		 *	cached until this node or one of its children changes.
+		**/
+		uint64_t hash() const
+		{
+			return YAMLDiff<Char, Links>::hash(this, true);
+		}
+
+		/*!
+		 *	Returns the start of the source line this node was parsed from,
+		 *	including indentation, or 0 if the node was not parsed. Inline
+		 *	comments share the line of their parent.
+		**/
+		inline const CharType *line() const
+		{
+			return _line;
+		}
+
+		/*!
+		 *	Returns the length of the source line, in terms of CharType, not
+		 *	including the newline.
+		**/
+		inline size_t lineSize() const
+		{
+			return _lineSize;
+		}
+
+		/*!
+		 *	Sets the source line and its size.
+		**/
+		void setLine(const CharType *line, size_t size)
+		{
+			_line = line;
+			_lineSize = size;
+		}
+		
+		/*!
+		 *	Returns true if the key or value was set after this node was
+		 *	created or parsed. Changes to children do not count.
+		**/
+		inline bool isModified() const
+		{
+			return _modified;
+		}
+		
+	protected:
+		template <typename, template <typename> class>
+			friend struct YAMLDocumentBase;
+
+		YAMLType _type;				// First, to fill the padding of NodeBase.
+		bool _modified;
+		const CharType *_key;
+		const CharType *_value;
+		const CharType *_line;
+		size_t _keySize;
+		size_t _valueSize;
+		size_t _lineSize;
+	};
+	
+	namespace Print
+	{
+		/*!
+		 *	Prints a YAML mapping element without its children.
+		**/
+		template <typename Printer, typename Char,
+			template <typename> class Links>
+			void printYAMLMapLine(Printer *printer,
+			const YAMLNode<Char, Links> *node, size_t indent = 0)
+		{
+			if (!printer->empty())
+			{
+				printer->append(1, '\n');
+			}
+			printer->append(indent, ' ');
+			printer->append(node->key(), node->keySize());
+			printer->append(": ");
+			if (node->value())
+			{
+				printer->append(node->value(), node->valueSize());
+			}
+		}
+		
+		/*!
+		 *	Prints a YAML sequence element without its children.
+		**/
+		template <typename Printer, typename Char,
+			template <typename> class Links>
+			void printYAMLListLine(Printer *printer,
+			const YAMLNode<Char, Links> *node, size_t indent = 0)
+		{
+			if (!printer->empty())
+			{
+				printer->append(1, '\n');
+			}
+			printer->append(indent, ' ');
+			printer->append("- ");
+			if (node->key())
+			{
+				printer->append(node->key(), node->keySize());
+				printer->append(": ");
+			}
+			printer->append(node->value(), node->valueSize());
+		}
+		
+		/*!
+		 *	Prints a YAML comment, on its own line at the indicated
+		 *	indentation or after the last line if it is inline.
+		**/
+		template <typename Printer, typename Char,
+			template <typename> class Links>
+			void printYAMLComment(Printer *printer,
+			YAMLNode<Char, Links> *node, size_t indent = 0)
+		{
+			if (node->type() & YAMLType::Flow)
+			{
+				printer->append(" # ");
+			}
+			else
+			{
+				if (!printer->empty())
+				{
+					printer->append(1, '\n');
+				}
+				printer->append(indent, ' ');
+				printer->append("# ");
+			}
+			printer->append(node->value(), node->valueSize());
+		}
+
+		/*!
+		 *	Prints a single YAML node without its children. Returns true if its
+		 *	children should be printed.
+		**/
+		template <typename Printer, typename Char,
+			template <typename> class Links>
+			bool printYAMLNode(Printer *printer,
+			const YAMLNode<Char, Links> *node, size_t indent = 0)
+		{
+			switch (node->type() & 0xF)
+			{
+			case YAMLType::Begin:
+				printer->append("---");
+				break;
+			case YAMLType::End:
+				printer->append("...");
+				break;
+			case YAMLType::Mapping:
+				printYAMLMapLine(printer, node, indent);
+				return true;
+			case YAMLType::Sequence:
+				printYAMLListLine(printer, node, indent);
+				return true;
+			case YAMLType::Directive:
+				printer->append(1, '%');
+				printer->append(node->key(), node->keySize());
+				if (node->value())
+				{
+					printer->append(" ");
+					printer->append(node->value(), node->valueSize());
+				}
+				break;
+			}
+			return false;
+		}
+		
+		/*!
+		 *	Prints the children of a YAML node. The tree is walked without
+		 *	recursion, so the nesting depth is not limited by the stack.
+		 *	Comment nodes and the nodes below them are left out; use
+		 *	printYAMLRoundTrip() to keep them.
+		**/
+		template <typename Printer, typename Char,
+			template <typename> class Links>
+			void printYAMLChildren(Printer *printer,
+			const NodeBase<YAMLNode<Char, Links>> *node, size_t indent = 0)
+		{
+			PreOrderIterator<YAMLNode<Char, Links>> child(node);
+			PreOrderIterator<YAMLNode<Char, Links>> end;
+			while (child != end)
+			{
+				if (printYAMLNode(printer, &*child, indent + 2 * child.depth()))
+				{
+					++child;
+				}
+				else
+				{
+					child.skipChildren();
+				}
+			}
+		}
+		
+		/*!
+		 *	Prints a YAML mapping element.
+		**/
+		template <typename Printer, typename Char,
+			template <typename> class Links>
+			void printYAMLMap(Printer *printer,
+			YAMLNode<Char, Links> *node, size_t indent = 0)
+		{
+			printYAMLMapLine(printer, node, indent);
+			printYAMLChildren(printer, node, indent + 2);
+		}
+		
+		/*!
+		 *	Prints a YAML sequence element.
+		**/
+		template <typename Printer, typename Char,
+			template <typename> class Links>
+			void printYAMLList(Printer *printer,
+			YAMLNode<Char, Links> *node, size_t indent = 0)
+		{
+			printYAMLListLine(printer, node, indent);
+			printYAMLChildren(printer, node, indent + 2);
+		}
+
+		/*!
+		 *	Returns whether a node is an inline comment, which shares the
+		 *	source line of its parent.
+		**/
+		template <typename Char, template <typename> class Links>
+			bool isInlineComment(const YAMLNode<Char, Links> *node)
+		{
+			if ((node->type() & 0xF) != YAMLType::Comment || !node->line())
+			{
+				return false;
+			}
+			size_t i = 0;
+			while (Char::isChar(node->line()[i], ' '))
+			{
+				++i;
+			}
+			return !Char::isChar(node->line()[i], '#');
+		}
+
+		/*!
+		 *	Returns whether a node's source line still reads as the node, that
+		 *	is, its key, value and inline comment are all unchanged.
+		**/
+		template <typename Char, template <typename> class Links>
+			bool isLineClean(const YAMLNode<Char, Links> *node)
+		{
+			if (!node->line() || node->isModified())
+			{
+				return false;
+			}
+			if ((node->type() & 0xF) == YAMLType::Comment)
+			{
+				return true;
+			}
+			const YAMLNode<Char, Links> *comment = node->firstChild();
+			if (comment && isInlineComment(comment))
+			{
+				return !comment->isModified();
+			}
+			for (size_t i = 0; i != node->lineSize(); ++i)
+			{
+				if (Char::isChar(node->line()[i], '#'))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		/*!
+		 *	Prints the children of a YAML node, copying every node that was
+		 *	not changed since parsing straight from its source text. Clean
+		 *	subtrees keep their original spacing, and runs of them that follow
+		 *	each other in the source, including nodes that shared a line, are
+		 *	copied in one append. Nodes that only have changed children keep
+		 *	their own line, and only changed or new nodes are printed again,
+		 *	at the indentation of their siblings. Inserted nodes, and children
+		 *	of nodes printed at a new indentation, are copied only where their
+		 *	source indentation still fits, and printed again otherwise.
+		 *	Text between nodes that made no node, such as blank lines, is only
+		 *	kept inside clean subtrees.
+		**/
+		template <typename Printer, typename Char,
+			template <typename> class Links>
+			void printYAMLRoundTrip(Printer *printer,
+			const NodeBase<YAMLNode<Char, Links>> *node)
+		{
+			typedef YAMLNode<Char, Links> Node;
+			typedef typename Char::CharType CharType;
+			PreOrderIterator<Node> child(node);
+			PreOrderIterator<Node> end;
+			// Indentation used for new nodes at each depth, the parent it was
+			// worked out for, and whether the last node at that depth was
+			// printed away from its source indentation.
+			struct Level
+			{
+				const Node *parent;
+				size_t indent;
+				bool shifted;
+			};
+			std::vector<Level> levels;
+			// End of the source line of the last node printed that has one.
+			const CharType *tail = nullptr;
+			// Source text waiting to be copied. Pieces on the same or the
+			// next source line with only blanks between them are joined, so
+			// unchanged runs take one append and shared lines stay whole.
+			const CharType *copyStart = nullptr;
+			const CharType *copyEnd = nullptr;
+			auto flush = [&]()
+			{
+				if (copyStart)
+				{
+					if (!printer->empty())
+					{
+						printer->append(1, '\n');
+					}
+					printer->append(copyStart, copyEnd - copyStart);
+					copyStart = nullptr;
+				}
+			};
+			auto copy = [&](const CharType *start, const CharType *stop)
+			{
+				// Lines end before the terminator, but never copy it anyway.
+				while (stop != start && Char::isChar(stop[-1], '\0'))
+				{
+					--stop;
+				}
+				bool join = copyStart && start >= copyEnd;
+				bool newline = false;
+				for (const CharType *gap = copyEnd; join && gap != start; ++gap)
+				{
+					if (Char::isChar(*gap, '\n'))
+					{
+						join = !newline;
+						newline = true;
+					}
+					else
+					{
+						join = Char::isChar(*gap, ' ') ||
+							Char::isChar(*gap, '\t') || Char::isChar(*gap, '\r');
+					}
+				}
+				if (!join)
+				{
+					flush();
+					copyStart = start;
+				}
+				copyEnd = stop;
+				tail = stop;
+			};
+			// Nothing below an unchanged root was moved, so its text is
+			// still in one piece.
+			const Node *first = node->firstChild();
+			if (first && isInlineComment(first))
+			{
+				first = first->nextSibling();
+			}
+			if (first && first->line() && !node->isDirty())
+			{
+				const Node *last = node->lastChild();
+				while (last->lastChild())
+				{
+					last = last->lastChild();
+				}
+				copy(first->line(), last->line() + last->lineSize());
+				child = end;
+			}
+			while (child != end)
+			{
+				size_t depth = child.depth();
+				if (isInlineComment(&*child))
+				{
+					child.skipChildren();
+					continue;
+				}
+				// Work out the indentation before descending, so children can
+				// line up with it. New nodes line up with the first sibling
+				// that was parsed in place, which must be deeper than the
+				// parent.
+				const Node *parent = child->parent();
+				levels.resize(depth + 1);
+				if (levels[depth].parent != parent)
+				{
+					const Node *sibling = depth ? parent->firstChild() :
+						node->firstChild();
+					while (sibling && (!sibling->line() ||
+						sibling->isInserted() || isInlineComment(sibling)))
+					{
+						sibling = sibling->nextSibling();
+					}
+					size_t indent = 0;
+					if (sibling)
+					{
+						while (Char::isChar(sibling->line()[indent], ' '))
+						{
+							++indent;
+						}
+					}
+					if (depth && (!sibling || indent <= levels[depth - 1].indent))
+					{
+						indent = levels[depth - 1].indent + 2;
+					}
+					levels[depth].parent = parent;
+					levels[depth].indent = indent;
+				}
+				size_t own = 0;
+				if (child->line())
+				{
+					while (Char::isChar(child->line()[own], ' '))
+					{
+						++own;
+					}
+				}
+				// Source text reads the same where nothing around it moved,
+				// and otherwise only where its indentation still fits.
+				bool fits = child->line() && (own == levels[depth].indent ||
+					(!child->isInserted() && (!depth ||
+					!levels[depth - 1].shifted)));
+				size_t indent = fits ? own : levels[depth].indent;
+				levels[depth].shifted = !fits;
+				if (fits && !child->isDirty())
+				{
+					const Node *last = &*child;
+					while (last->lastChild())
+					{
+						last = last->lastChild();
+					}
+					copy(child->line(), last->line() + last->lineSize());
+					child.skipChildren();
+					continue;
+				}
+				if (child->line())
+				{
+					tail = child->line() + child->lineSize();
+				}
+
+				if (fits && isLineClean(&*child))
+				{
+					copy(child->line(), child->line() + child->lineSize());
+					++child;
+					continue;
+				}
+				flush();
+
+				switch (child->type() & 0xF)
+				{
+				case YAMLType::Begin:
+				case YAMLType::End:
+				case YAMLType::Directive:
+					if (!printer->empty())
+					{
+						printer->append(1, '\n');
+					}
+					break;
+				case YAMLType::Comment:
+					if (!printer->empty())
+					{
+						printer->append(1, '\n');
+					}
+					printer->append(indent, ' ');
+					printer->append("# ");
+					printer->append(child->value(), child->valueSize());
+					break;
+				}
+				// Comments print nothing here, but may hold the nodes below
+				// them.
+				bool children = printYAMLNode(printer, &*child, indent) ||
+					(child->type() & 0xF) == YAMLType::Comment;
+				const Node *comment = child->firstChild();
+				if (comment && isInlineComment(comment))
+				{
+					printer->append(" # ");
+					printer->append(comment->value(), comment->valueSize());
+				}
+				if (children)
+				{
+					++child;
+				}
+				else
+				{
+					child.skipChildren();
+				}
+			}
+			flush();
+			if (tail && Char::isChar(*tail, '\n'))
+			{
+				printer->append(1, '\n');
+			}
+		}
+
+		/*!
+		 *	A printer that only counts the characters it is given. Any type
+		 *	with std::string's empty() and append() calls can be printed to.
+		 *	If started is true, the printer acts as if it was not empty.
+		**/
+		struct CountPrinter
+		{
+			explicit CountPrinter(bool started = false) : size(0),
+				_started(started) {}
+
+			inline bool empty() const
+			{
+				return !_started && !size;
+			}
+
+			inline void append(size_t count, char)
+			{
+				size += count;
+			}
+
+			inline void append(const char *string)
+			{
+				size += strlen(string);
+			}
+
+			template <typename CharType> inline void append(const CharType *,
+				size_t count)
+			{
+				size += count;
+			}
+
+			size_t size;
+
+		private:
+			bool _started;
+		};
+
+		/*!
+		 *	A printer that writes into memory that was sized by a CountPrinter.
+		**/
+		struct SpanPrinter
+		{
+			SpanPrinter(char *data, bool started) : _data(data),
+				_position(data), _started(started) {}
+
+			inline bool empty() const
+			{
+				return !_started && _position == _data;
+			}
+
+			inline void append(size_t count, char ch)
+			{
+				memset(_position, ch, count);
+				_position += count;
+			}
+
+			inline void append(const char *string)
+			{
+				append(string, strlen(string));
+			}
+
+			inline void append(const char *string, size_t count)
+			{
+				if (count)
+				{
+					memcpy(_position, string, count);
+					_position += count;
+				}
+			}
+
+		private:
+			char *_data;
+			char *_position;
+			bool _started;
+		};
+
+		/*!
+		 *	A printer that writes to a file through a fixed size buffer, so the
+		 *	printed text never has to fit in memory.
+		**/
+		struct FilePrinter
+		{
+			explicit FilePrinter(std::FILE *file, size_t bufferSize = 64 * 1024) :
+				_file(file), _buffer(bufferSize ? bufferSize : 1), _used(0),
+				_written(0) {}
+
+			~FilePrinter()
+			{
+				flush();
+			}
+
+			inline bool empty() const
+			{
+				return !_written && !_used;
+			}
+
+			void append(size_t count, char ch)
+			{
+				while (count)
+				{
+					if (_used == _buffer.size())
+					{
+						flush();
+					}
+					size_t size = _buffer.size() - _used;
+					size = count < size ? count : size;
+					memset(&_buffer[_used], ch, size);
+					_used += size;
+					count -= size;
+				}
+			}
+
+			inline void append(const char *string)
+			{
+				append(string, strlen(string));
+			}
+
+			void append(const char *string, size_t count)
+			{
+				if (count > _buffer.size() - _used)
+				{
+					flush();
+					if (count >= _buffer.size())
+					{
+						std::fwrite(string, 1, count, _file);
+						_written += count;
+						return;
+					}
+				}
+				if (count)
+				{
+					memcpy(&_buffer[_used], string, count);
+					_used += count;
+				}
+			}
+
+			/*!
+			 *	Writes the buffered text. Returns false if writing failed.
+			**/
+			bool flush()
+			{
+				if (_used)
+				{
+					std::fwrite(_buffer.data(), 1, _used, _file);
+					_written += _used;
+					_used = 0;
+				}
+				return !std::ferror(_file);
+			}
+
+		private:
+			FilePrinter(const FilePrinter &);
+			FilePrinter &operator=(const FilePrinter &);
+
+			std::FILE *_file;
+			std::vector<char> _buffer;
+			size_t _used;
+			uint64_t _written;
+		};
+
+#ifdef SIPYAML_THREADS
+		/*!
+		 *	A fixed group of threads that runs batches of indexed work, so
+		 *	several passes can share the same threads. The calling thread takes
+		 *	part in every batch, and threads take the next index when they
+		 *	finish one, so uneven work is balanced.
+		**/
+		struct WorkerGroup
+		{
+			/*!
+			 *	Starts one less than the indicated number of threads.
+			**/
+			explicit WorkerGroup(size_t threads) : _work(nullptr),
+				_context(nullptr), _count(0), _next(0), _batch(0), _busy(0),
+				_stopping(false)
+			{
+				for (size_t i = 1; i < threads; ++i)
+				{
+					_threads.push_back(std::thread([this]() { serve(); }));
+				}
+			}
+
+			~WorkerGroup()
+			{
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					_stopping = true;
+				}
+				_started.notify_all();
+				for (size_t i = 0; i != _threads.size(); ++i)
+				{
+					_threads[i].join();
+				}
+			}
+
+			/*!
+			 *	Calls work once for every index below count, and returns when
+			 *	every call has returned.
+			**/
+			template <typename Work> void run(size_t count, const Work &work)
+			{
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					_work = &call<Work>;
+					_context = &work;
+					_count = count;
+					_next = 0;
+					_busy = _threads.size();
+					++_batch;
+				}
+				_started.notify_all();
+				take();
+				std::unique_lock<std::mutex> lock(_mutex);
+				_finished.wait(lock, [this]() { return !_busy; });
+			}
+
+		private:
+			WorkerGroup(const WorkerGroup &);
+			WorkerGroup &operator=(const WorkerGroup &);
+
+			template <typename Work> static void call(const void *work,
+				size_t index)
+			{
+				(*static_cast<const Work*>(work))(index);
+			}
+
+			void take()
+			{
+				size_t i;
+				while ((i = _next++) < _count)
+				{
+					_work(_context, i);
+				}
+			}
+
+			void serve()
+			{
+				uint64_t batch = 0;
+				std::unique_lock<std::mutex> lock(_mutex);
+				while (1)
+				{
+					_started.wait(lock, [&]()
+					{
+						return _stopping || _batch != batch;
+					});
+					if (_stopping)
+					{
+						return;
+					}
+					batch = _batch;
+					lock.unlock();
+					take();
+					lock.lock();
+					if (!--_busy)
+					{
+						_finished.notify_one();
+					}
+				}
+			}
+
+			std::vector<std::thread> _threads;
+			std::mutex _mutex;
+			std::condition_variable _started;	// A batch or stop was posted.
+			std::condition_variable _finished;	// The last thread is done.
+			void (*_work)(const void *, size_t);
+			const void *_context;
+			size_t _count;
+			std::atomic<size_t> _next;
+			uint64_t _batch;					// Number of batches posted.
+			size_t _busy;						// Threads still in the batch.
+			bool _stopping;
+		};
+
+		/*!
+		 *	Prints the children of a YAML node using up to the indicated number
+		 *	of threads, or one per hardware thread if 0. The subtree of each
+		 *	child is measured and then printed straight into its own part of
+		 *	printer, so the output is the same as printYAMLChildren(). Both
+		 *	passes run on the same threads. Where the standard library has
+		 *	resize_and_overwrite(), the output is not zero filled first.
+		**/
+		template <typename Char, template <typename> class Links>
+			void printYAMLChildrenParallel(std::string *printer,
+			const NodeBase<YAMLNode<Char, Links>> *node, size_t indent = 0,
+			size_t threads = 0)
+		{
+			typedef YAMLNode<Char, Links> Node;
+			if (!threads)
+			{
+				threads = std::thread::hardware_concurrency();
+			}
+			if (threads < 2 || !node->firstChild() ||
+				!node->firstChild()->nextSibling())
+			{
+				printYAMLChildren(printer, node, indent);
+				return;
+			}
+
+			// Whether a newline goes before each subtree depends on whether
+			// anything was printed before it, which only top nodes decide.
+			std::vector<const Node*> subtrees;
+			std::vector<char> started;
+			bool printed = !printer->empty();
+			for (const Node *child = node->firstChild(); child;
+				child = child->nextSibling())
+			{
+				subtrees.push_back(child);
+				started.push_back(printed);
+				CountPrinter top(printed);
+				printYAMLNode(&top, child, indent);
+				printed = printed || top.size;
+			}
+			threads = threads < subtrees.size() ? threads : subtrees.size();
+
+			WorkerGroup workers(threads);
+			std::vector<size_t> offsets(subtrees.size() + 1, printer->size());
+			workers.run(subtrees.size(), [&](size_t i)
+			{
+				CountPrinter count(started[i] != 0);
+				if (printYAMLNode(&count, subtrees[i], indent))
+				{
+					printYAMLChildren(&count, subtrees[i], indent + 2);
+				}
+				offsets[i + 1] = count.size;
+			});
+			for (size_t i = 0; i != subtrees.size(); ++i)
+			{
+				offsets[i + 1] += offsets[i];
+			}
+
+			auto print = [&](char *data)
+			{
+				workers.run(subtrees.size(), [&](size_t i)
+				{
+					SpanPrinter span(data + offsets[i], started[i] != 0);
+					if (printYAMLNode(&span, subtrees[i], indent))
+					{
+						printYAMLChildren(&span, subtrees[i], indent + 2);
+					}
+				});
+			};
+#ifdef __cpp_lib_string_resize_and_overwrite
+			printer->resize_and_overwrite(offsets.back(),
+				[&](char *data, size_t)
+			{
+				// Some libraries pass the capacity rather than the size.
+				print(data);
+				return offsets.back();
+			});
+#else
+			printer->resize(offsets.back());
+			print(&(*printer)[0]);
+#endif
+		}
+
+#endif // SIPYAML_THREADS
+	}
+
+	/*!
+	 *	Writes YAML text without building a document. Each call prints what a
+	 *	node with the same contents would print, so the output is identical to
+	 *	printing the equivalent document. Comments are the exception: print()
+	 *	leaves Comment nodes out, so only printRoundTrip() of the equivalent
+	 *	document prints them. Only the indentation of each open level is
+	 *	kept. Strings must stay valid until the next call.
+	 *
+	 *	key() followed by scalar() writes a mapping element, and scalar() on
+	 *	its own writes a sequence element. Inside a sequence, key() writes a
+	 *	sequence element with a key. beginMapping() and beginSequence() right
+	 *	after an element open a level for its children; inside a sequence,
+	 *	beginMapping() on its own starts an element whose first key shares
+	 *	the dash. end() closes the innermost level.
+	**/
+	template <typename Char, typename Printer = std::string>
+		struct YAMLWriterBase
+	{
+		typedef typename Char::CharType CharType;
+		typedef YAMLNode<Char> Node;
+
+		/*!
+		 *	Creates a writer that appends to the indicated printer.
+		**/
+		explicit YAMLWriterBase(Printer *printer) : _printer(printer),
+			_key(nullptr), _keySize(0), _hasKey(false), _hasElement(false),
+			_elementIndent(0)
+		{
+			Level level = {0, Mapping};
+			_levels.push(level);
+		}
+
+		~YAMLWriterBase()
+		{
+			flush();
+		}
+
+		/*!
+		 *	Writes a key. Its value, if any, is given by the next scalar().
+		**/
+		void key(const CharType *key, size_t size)
+		{
+			flush();
+			_key = key;
+			_keySize = size;
+			_hasKey = true;
+		}
+
+		void key(const CharType *key)
+		{
+			this->key(key, Unicode::datalen(key));
+		}
+
+		/*!
+		 *	Writes the value of the last key, or a sequence element if there is
+		 *	no key waiting for one.
+		**/
+		void scalar(const CharType *value, size_t size)
+		{
+			write(_hasKey ? _key : nullptr, _keySize, value, size);
+			_hasKey = false;
+		}
+
+		void scalar(const CharType *value)
+		{
+			scalar(value, Unicode::datalen(value));
+		}
+
+		/*!
+		 *	Opens a level for the children of the last element, or starts a
+		 *	mapping element inside a sequence.
+		**/
+		void beginMapping()
+		{
+			flush();
+			if (!_hasElement)
+			{
+				assert(_levels.top().type == Sequence);
+				Level level = {_levels.top().indent, Begin};
+				_levels.push(level);
+				return;
+			}
+			Level level = {_elementIndent + 2, Mapping};
+			_levels.push(level);
+			_hasElement = false;
+		}
+
+		/*!
+		 *	Opens a level for the sequence elements of the last element.
+		**/
+		void beginSequence()
+		{
+			flush();
+			assert(_hasElement);
+			Level level = {_elementIndent + 2, Sequence};
+			_levels.push(level);
+			_hasElement = false;
+		}
+
+		/*!
+		 *	Closes the innermost level.
+		**/
+		void end()
+		{
+			flush();
+			assert(_levels.size() > 1);
+			_levels.pop();
+			_hasElement = false;
+		}
+
+		/*!
+		 *	Writes a comment on its own line at the indentation of the open
+		 *	level, or after the last element if isInline is true.
+		**/
+		void comment(const CharType *value, size_t size, bool isInline = false)
+		{
+			flush();
+			Node node(static_cast<YAMLType>(isInline ? Comment | Flow : Comment),
+				nullptr, 0, value, size);
+			Print::printYAMLComment(_printer, &node, _levels.top().indent);
+		}
+
+		void comment(const CharType *value, bool isInline = false)
+		{
+			comment(value, Unicode::datalen(value), isInline);
+		}
+
+		/*!
+		 *	Writes a directive, a document begin marker or a document end
+		 *	marker. These can only appear at the top level.
+		**/
+		void directive(const CharType *key, size_t keySize,
+			const CharType *value = nullptr, size_t valueSize = 0)
+		{
+			writeMarker(Directive, key, keySize, value, valueSize);
+		}
+
+		void beginDocument()
+		{
+			writeMarker(Begin);
+		}
+
+		void endDocument()
+		{
+			writeMarker(End);
+		}
+
+		/*!
+		 *	Writes a key that is still waiting for a value. This is done by
+		 *	every other call and when the writer is destroyed.
+		**/
+		void flush()
+		{
+			if (_hasKey)
+			{
+				_hasKey = false;
+				write(_key, _keySize, nullptr, 0);
+			}
+		}
+
+	private:
+		YAMLWriterBase(const YAMLWriterBase &);
+		YAMLWriterBase &operator=(const YAMLWriterBase &);
+
+		/*!
+		 *	An open level. Its type is Mapping or Sequence, or Begin for a
+		 *	sequence element whose first key has not been written yet.
+		**/
+		struct Level
+		{
+			size_t indent;
+			YAMLType type;
+		};
+
+		void write(const CharType *key, size_t keySize, const CharType *value,
+			size_t valueSize)
+		{
+			Level &level = _levels.top();
+			YAMLType type = key && level.type == Mapping ? Mapping : Sequence;
+			Node node(type, key, keySize, value, valueSize);
+			Print::printYAMLNode(_printer, &node, level.indent);
+			_hasElement = true;
+			_elementIndent = level.indent;
+			if (level.type == Begin)
+			{
+				level.indent += 2;
+				level.type = Mapping;
+			}
+		}
+
+		void writeMarker(YAMLType type, const CharType *key = nullptr,
+			size_t keySize = 0, const CharType *value = nullptr,
+			size_t valueSize = 0)
+		{
+			flush();
+			assert(_levels.size() == 1);
+			Node node(type, key, keySize, value, valueSize);
+			Print::printYAMLNode(_printer, &node);
+			_hasElement = false;
+		}
+
+		Printer *_printer;
+		stack<Level> _levels;
+		const CharType *_key;
+		size_t _keySize;
+		bool _hasKey;
+		bool _hasElement;			// The last call wrote an element.
+		size_t _elementIndent;
+	};
+
+	typedef YAMLWriterBase<Unicode::CharUTF8> YAMLWriterUTF8;
+
+	/*!
+	 *	The header at the start of a document image. A document image is a
+	 *	position independent copy of a parsed document that can be memory mapped
+	 *	and traversed without parsing.
+	**/
+	struct YAMLImageHeader
+	{
+		char magic[8];				//!< Always "SipYAML" and a null character.
+		uint32_t version;			//!< The image format version.
+		uint32_t charSize;			//!< The size of CharType, in bytes.
+		uint64_t checksum;			/*!< The checksum of the header, with this
+										field as 0, and of the node table. */
+		uint64_t nodeCount;			//!< The number of nodes, including the root.
+		uint64_t stringSize;		//!< The size of the string table, in bytes.
+		uint64_t sourceSize;		//!< The size of the source file, in bytes.
+		int64_t sourceTime;			//!< The source file modification time.
+	};
+
+	/*!
+	 *	A read-only node stored inside of a document image. All links are stored
+	 *	as 32 bit offsets relative to the node itself, so the image can be
+	 *	placed at any address. It has the same traversal functions as YAMLNode.
+	 *	Nodes are stored in pre-order, so the first child directly follows its
+	 *	parent, and previousSibling() has to walk the siblings like with
+	 *	ForwardLinks.
+	**/
+	template <typename Char> struct YAMLImageNode
+	{
+		typedef typename Char::CharType CharType;
+
+		/*!
+		 *	Returns the YAML type.
+		**/
+		inline YAMLType type() const
+		{
+			return static_cast<YAMLType>(_type);
+		}
+
+		/*!
+		 *	Returns the key, or 0 if this node does not have a key.
+		**/
+		inline const CharType *key() const
+		{
+			return string(_key);
+		}
+
+		/*!
+		 *	Returns the length of the key, in terms of CharType.
+		**/
+		inline size_t keySize() const
+		{
+			return _keySize;
+		}
+
+		/*!
+		 *	Returns the value, or 0 if this node does not have a value.
+		**/
+		inline const CharType *value() const
+		{
+			return string(_value);
+		}
+
+		/*!
+		 *	Returns the length of the value, in terms of CharType.
+		**/
+		inline size_t valueSize() const
+		{
+			return _valueSize;
+		}
+
+		/*!
+		 *	Returns this node's parent, or 0 if it does not have one.
+		**/
+		inline const YAMLImageNode *parent() const
+		{
+			return link(_parent);
+		}
+
+		/*!
+		 *	Returns this node's next sibling, or 0 if it does not have one.
+		**/
+		inline const YAMLImageNode *nextSibling() const
+		{
+			return link(_nextSibling);
+		}
+
+		/*!
+		 *	Returns this node's previous sibling, or 0 if it does not have one.
+		 *	This walks the siblings before it.
+		**/
+		inline const YAMLImageNode *previousSibling() const
+		{
+			const YAMLImageNode *parent = link(_parent);
+			const YAMLImageNode *sibling = parent ? parent + 1 : this;
+			if (sibling == this)
+			{
+				return nullptr;
+			}
+			while (sibling->link(sibling->_nextSibling) != this)
+			{
+				sibling = sibling->link(sibling->_nextSibling);
+			}
+			return sibling;
+		}
+
+		/*!
+		 *	Returns this node's first child, or 0 if it does not have one.
+		**/
+		inline const YAMLImageNode *firstChild() const
+		{
+			return _lastChild ? this + 1 : nullptr;
+		}
+
+		/*!
+		 *	Returns this node's last child, or 0 if it does not have one.
+		**/
+		inline const YAMLImageNode *lastChild() const
+		{
+			return link(_lastChild);
+		}
+
+	private:
+
+		template <typename> friend struct ImageWriter;
+
+		inline const YAMLImageNode *link(int32_t offset) const
+		{
+			return offset ? this + offset : nullptr;
+		}
+
+		inline const CharType *string(uint32_t offset) const
+		{
+			return offset ? reinterpret_cast<const CharType*>(
+				reinterpret_cast<const char*>(this) + offset) : 0;
+		}
+
+		uint32_t _key;				// Byte offset of the key, or 0.
+		uint32_t _value;			// Byte offset of the value, or 0.
+		uint32_t _keySize;
+		uint32_t _valueSize;
+		int32_t _parent;			// Links are in nodes, 0 means none.
+		int32_t _nextSibling;
+		int32_t _lastChild;			// The first child follows this node.
+		uint8_t _type;
+	};
+
+	namespace Image
+	{
+		/*!
+		 *	The current document image format version. Images with any other
+		 *	version are treated as stale.
+		**/
+		const uint32_t Version = 2;
+
+		/*!
+		 *	The largest image, in bytes. Offsets from nodes to their strings
+		 *	must fit in 32 bits.
+		**/
+		const uint64_t MaxSize = 0xFFFFFFFFULL;
+
+		/*!
+		 *	Returns the checksum of an image header and the node table that
+		 *	follows it. The string table is not included, so checking an image
+		 *	does not read the whole file; damaged strings can give wrong
+		 *	values, but every node still points inside the image.
+		**/
+		inline uint64_t checksum(const YAMLImageHeader &header,
+			const char *nodes, size_t size)
+		{
+			YAMLImageHeader copy = header;
+			copy.checksum = 0;
+			return Hash::words(nodes, size, Hash::words(&copy, sizeof(copy)));
+		}
+	}
+
+	/*!
+	 *	Converts a document into a document image.
+	**/
+	template <typename Char> struct ImageWriter
+	{
+		typedef typename Char::CharType CharType;
+		typedef YAMLImageNode<Char> ImageNode;
+
+		/*!
+		 *	Appends the image of every child of the indicated node to image. The
+		 *	source size and time are stored so that loaders can detect when the
+		 *	image is older than the file it was parsed from. Returns false and
+		 *	leaves image unchanged if the image would be larger than
+		 *	Image::MaxSize.
+		**/
+		template <template <typename> class Links>
+			static bool write(std::string *image,
+			const NodeBase<YAMLNode<Char, Links>> *document,
+			uint64_t sourceSize = 0, int64_t sourceTime = 0)
+		{
+			std::vector<ImageNode> nodes(1);
+			std::string strings;
+			std::vector<int32_t> parents;
+			nodes[0]._type = Begin;
+			parents.push_back(0);
+
+			// Pre-order walk, linking each node to its last written sibling.
+			// The image index of each parent is kept by depth.
+			PreOrderIterator<YAMLNode<Char, Links>> node(document);
+			PreOrderIterator<YAMLNode<Char, Links>> end;
+			for (; node != end; ++node)
+			{
+				int32_t index = static_cast<int32_t>(nodes.size());
+				parents.resize(node.depth() + 1);
+				int32_t parent = parents.back();
+				parents.push_back(index);
+				nodes.push_back(ImageNode());
+				ImageNode &item = nodes.back();
+				item._type = node->type();
+				item._key = addString(&strings, node->key(), node->keySize());
+				item._keySize = static_cast<uint32_t>(node->keySize());
+				item._value = addString(&strings, node->value(),
+					node->valueSize());
+				item._valueSize = static_cast<uint32_t>(node->valueSize());
+				item._parent = parent - index;
+				if (nodes[parent]._lastChild)
+				{
+					int32_t previous = parent + nodes[parent]._lastChild;
+					nodes[previous]._nextSibling = index - previous;
+				}
+				nodes[parent]._lastChild = index - parent;
+			}
+			if (sizeof(YAMLImageHeader) + nodes.size() * sizeof(ImageNode) +
+				strings.size() > Image::MaxSize)
+			{
+				return false;
+			}
+
+			// String offsets were stored one past their table position.
+			size_t count = nodes.size();
+			for (size_t i = 0; i != count; ++i)
+			{
+				uint32_t base = static_cast<uint32_t>(
+					(count - i) * sizeof(ImageNode) - 1);
+				if (nodes[i]._key)
+				{
+					nodes[i]._key += base;
+				}
+				if (nodes[i]._value)
+				{
+					nodes[i]._value += base;
+				}
+			}
+
+			YAMLImageHeader header;
+			memset(&header, 0, sizeof(header));
+			memcpy(header.magic, "SipYAML", 8);
+			header.version = Image::Version;
+			header.charSize = sizeof(CharType);
+			header.nodeCount = nodes.size();
+			header.stringSize = strings.size();
+			header.sourceSize = sourceSize;
+			header.sourceTime = sourceTime;
+
+			size_t start = image->size();
+			image->append(reinterpret_cast<const char*>(&header),
+				sizeof(header));
+			image->append(reinterpret_cast<const char*>(nodes.data()),
+				nodes.size() * sizeof(ImageNode));
+			image->append(strings);
+			header.checksum = Image::checksum(header,
+				image->data() + start + sizeof(header),
+				nodes.size() * sizeof(ImageNode));
+			image->replace(start, sizeof(header),
+				reinterpret_cast<const char*>(&header), sizeof(header));
+			return true;
+		}
+
+	private:
+
+		static uint32_t addString(std::string *strings, const CharType *data,
+			size_t size)
+		{
+			if (!data)
+			{
+				return 0;
+			}
+			uint32_t offset = static_cast<uint32_t>(strings->size()) + 1;
+			strings->append(reinterpret_cast<const char*>(data),
+				size * sizeof(CharType));
+			return offset;
+		}
+	};
+
+	/*!
+	 *	The kind of difference between two documents.
+	**/
+	enum YAMLChange : uint8_t
+	{
+		Added		=	0,			//!< The node only exists in the current one.
+		Removed		=	1,			//!< The node only exists in the previous one.
+		Changed		=	2			/*!< The node exists in both, but its type
+										flags or value changed. Its children
+										are reported separately. */
+	};
+
+	/*!
+	 *	A single difference between two documents. The previous node is 0 when
+	 *	the node was added and the current node is 0 when it was removed.
+	**/
+	template <typename Char, template <typename> class Links = FullLinks>
+		struct YAMLDifference
+	{
+		YAMLChange change;
+		const YAMLNode<Char, Links> *previous;
+		const YAMLNode<Char, Links> *current;
+	};
+
+	/*!
+	 *	Compares documents using cached subtree hashes. Subtrees with equal
+	 *	hashes are skipped, so after a small change only the nodes along the
+	 *	changed paths and their siblings are visited.
+	**/
+	template <typename Char, template <typename> class Links> struct YAMLDiff
+	{
+		typedef typename Char::CharType CharType;
+		typedef YAMLNode<Char, Links> Node;
+		typedef NodeBase<Node> Base;
+		typedef YAMLDifference<Char, Links> Difference;
+
+		/*!
+		 *	Returns the hash of the indicated subtree, computing it for every
+		 *	node that does not have a cached hash yet. If the root is not a
+		 *	node, such as a document, only its children are hashed.
+		**/
+		static uint64_t hash(const Base *root, bool isNode = false)
+		{
+			if (root->_hash)
+			{
+				return root->_hash;
+			}
+
+			// Post-order walk that skips subtrees with a cached hash.
+			const Base *node = root;
+			while (1)
+			{
+				const Node *child = node->firstChild();
+				while (child && child->_hash)
+				{
+					child = child->nextSibling();
+				}
+				if (child)
+				{
+					node = child;
+					continue;
+				}
+
+				uint64_t hash = 0x5369705941ULL;
+				if (node != root || isNode)
+				{
+					hash = own(static_cast<const Node*>(node));
+				}
+				for (child = node->firstChild(); child;
+					child = child->nextSibling())
+				{
+					hash = Hash::combine(hash, child->_hash);
+				}
+				node->_hash = hash ? hash : 1;
+				if (node == root)
+				{
+					return hash ? hash : 1;
+				}
+
+				const Node *next = static_cast<const Node*>(node)->nextSibling();
+				while (next && next->_hash)
+				{
+					next = next->nextSibling();
+				}
+				node = next ? next : static_cast<const Node*>(node)->parent();
+			}
+		}
+
+		/*!
+		 *	Appends the differences between the children of the previous and
+		 *	current nodes to differences, parents before their children.
+		 *	Children are matched by type and key; children sharing both are
+		 *	matched in order.
+		**/
+		static void diff(const Base *previous, const Base *current,
+			std::vector<Difference> *differences)
+		{
+			std::vector<std::pair<const Base*, const Base*>> pending;
+			pending.push_back(std::make_pair(previous, current));
+			while (!pending.empty())
+			{
+				const Base *before = pending.back().first;
+				const Base *after = pending.back().second;
+				pending.pop_back();
+
+				// Pair children in order until they stop matching.
+				const Node *x = before->firstChild();
+				const Node *y = after->firstChild();
+				while (x && y && sameIdentity(x, y))
+				{
+					compare(x, y, &pending, differences);
+					x = x->nextSibling();
+					y = y->nextSibling();
+				}
+				if (x || y)
+				{
+					match(x, y, &pending, differences);
+				}
+			}
+		}
+
+		/*!
+		 *	Appends the path of the indicated node to printer, such as
+		 *	"product/[1]/sku". Sequence entries are shown by their index among
+		 *	the entries of their sequence, followed by their key if they have
+		 *	one. Other nodes without a key are shown by their sibling index.
+		**/
+		static void printPath(std::string *printer, const Node *node)
+		{
+			std::vector<const Node*> path;
+			for (; node && node->parent(); node = node->parent())
+			{
+				path.push_back(node);
+			}
+			while (!path.empty())
+			{
+				node = path.back();
+				path.pop_back();
+				bool isEntry = (node->type() & 0xF) == YAMLType::Sequence;
+				if (isEntry || !node->key())
+				{
+					size_t index = 0;
+					for (const Node *sibling = node->previousSibling(); sibling;
+						sibling = sibling->previousSibling())
+					{
+						if (!isEntry ||
+							(sibling->type() & 0xF) == YAMLType::Sequence)
+						{
+							++index;
+						}
+					}
+					printer->append(1, '[');
+					printer->append(std::to_string(index));
+					printer->append(1, ']');
+				}
+				if (node->key())
+				{
+					Unicode::String<CharType> key = Unicode::trim<Char>(
+						node->key(), node->keySize());
+					if (isEntry)
+					{
+						printer->append(1, '/');
+					}
+					printer->append(key.data, key.size);
+				}
+				if (!path.empty())
+				{
+					printer->append(1, '/');
+				}
+			}
+		}
+
+	private:
+
+		typedef std::vector<std::pair<const Base*, const Base*>> Pending;
+
+		static uint64_t own(const Node *node)
+		{
+			uint64_t hash = node->type();
+			hash = Hash::combine(hash, node->key() ? Hash::bytes(node->key(),
+				node->keySize() * sizeof(CharType)) : 0);
+			hash = Hash::combine(hash, node->value() ? Hash::bytes(
+				node->value(), node->valueSize() * sizeof(CharType)) : 0);
+			return hash;
+		}
+
+		static uint64_t identity(const Node *node)
+		{
+			return Hash::combine(node->type() & 0xF, node->key() ?
+				Hash::bytes(node->key(), node->keySize() * sizeof(CharType)) :
+				0);
+		}
+
+		static inline bool sameString(const CharType *a, size_t aSize,
+			const CharType *b, size_t bSize)
+		{
+			return !a == !b && aSize == bSize &&
+				(!a || memcmp(a, b, aSize * sizeof(CharType)) == 0);
+		}
+
+		static inline bool sameIdentity(const Node *x, const Node *y)
+		{
+			return (x->type() & 0xF) == (y->type() & 0xF) &&
+				sameString(x->key(), x->keySize(), y->key(), y->keySize());
+		}
+
+		/*!
+		 *	Compares two nodes with the same identity.
+		**/
+		static void compare(const Node *x, const Node *y, Pending *pending,
+			std::vector<Difference> *differences)
+		{
+			if (hash(x, true) == hash(y, true))
+			{
+				return;
+			}
+			if (x->type() != y->type() || !sameString(x->value(),
+				x->valueSize(), y->value(), y->valueSize()))
+			{
+				Difference difference = {Changed, x, y};
+				differences->push_back(difference);
+			}
+			if (x->firstChild() || y->firstChild())
+			{
+				pending->push_back(std::make_pair(x, y));
+			}
+		}
+
+		/*!
+		 *	Matches the remaining siblings starting at x and y by identity and
+		 *	by their order among siblings with the same identity.
+		**/
+		static void match(const Node *x, const Node *y, Pending *pending,
+			std::vector<Difference> *differences)
+		{
+			std::unordered_map<uint64_t, size_t> counts;
+			std::unordered_map<uint64_t, const Node*> previous;
+			std::vector<uint64_t> keys;
+			for (; x; x = x->nextSibling())
+			{
+				uint64_t id = identity(x);
+				id = Hash::combine(id, counts[id]++);
+				keys.push_back(id);
+				previous.insert(std::make_pair(id, x));
+			}
+
+			counts.clear();
+			for (; y; y = y->nextSibling())
+			{
+				uint64_t id = identity(y);
+				id = Hash::combine(id, counts[id]++);
+				auto found = previous.find(id);
+				if (found != previous.end() && sameIdentity(found->second, y))
+				{
+					compare(found->second, y, pending, differences);
+					previous.erase(found);
+				}
+				else
+				{
+					Difference difference = {Added, nullptr, y};
+					differences->push_back(difference);
+				}
+			}
+
+			// Whatever is left in order was removed.
+			for (size_t i = 0; i != keys.size(); ++i)
+			{
+				auto found = previous.find(keys[i]);
+				if (found != previous.end())
+				{
+					Difference difference = {Removed, found->second, nullptr};
+					differences->push_back(difference);
+					previous.erase(found);
+				}
+			}
+		}
+	};
+
+	/*!
+	 *	How the values of a YAMLColumns column are stored.
+	**/
+	enum YAMLColumnType : uint8_t
+	{
+		Text		=	0,			//!< Spans of the values, not copied.
+		Integer		=	1,			//!< 64-bit signed integers.
+		Real		=	2			//!< Doubles.
+	};
+
+	/*!
+	 *	Extracts chosen keys from the rows of a table, such as a sequence of
+	 *	mappings, into one buffer per key. Each child of the table node is a
+	 *	row, and its fields are its own key and the keys of its children, so
+	 *	both "- sku: A" elements with children and mappings with children
+	 *	work. Keys and values are matched and stored without the spaces
+	 *	around them.
+	 *
+	 *	The rows are walked once, storing a span per column and row. Number
+	 *	columns are then converted column by column in a tight loop, reading
+	 *	eight digits at a time where possible.
+	**/
+	template <typename Char, template <typename> class Links = FullLinks>
+		struct YAMLColumns
+	{
+		typedef typename Char::CharType CharType;
+		typedef YAMLNode<Char, Links> Node;
+
+		/*!
+		 *	A value in the source text. data is 0 if the row has no value for
+		 *	the column.
+		**/
+		typedef Unicode::String<CharType> Span;
+
+		/*!
+		 *	The values of a key. spans is filled for every type. integers or
+		 *	reals is filled for number columns, with valid set to 0 for rows
+		 *	whose value is missing or not a number.
+		**/
+		struct Column
+		{
+			const CharType *key;
+			size_t keySize;
+			YAMLColumnType type;
+			std::vector<Span> spans;
+			std::vector<int64_t> integers;
+			std::vector<double> reals;
+			std::vector<char> valid;
+		};
+
+		YAMLColumns() : _rows(0) {}
+
+		/*!
+		 *	Adds a column for the indicated key. The key is not copied.
+		**/
+		void addColumn(const CharType *key, size_t keySize,
+			YAMLColumnType type = Text)
+		{
+			Column column;
+			column.key = key;
+			column.keySize = keySize;
+			column.type = type;
+			_columns.push_back(std::move(column));
+		}
+
+		void addColumn(const CharType *key, YAMLColumnType type = Text)
+		{
+			addColumn(key, Unicode::datalen(key), type);
+		}
+
+		/*!
+		 *	Fills the columns from the children of the indicated node,
+		 *	replacing what was extracted before. Returns the number of rows.
+		**/
+		size_t extract(const NodeBase<Node> *table)
+		{
+			_rows = 0;
+			for (size_t i = 0; i != _columns.size(); ++i)
+			{
+				_columns[i].spans.clear();
+			}
+			for (const Node *row = table->firstChild(); row;
+				row = row->nextSibling())
+			{
+				if ((row->type() & 0xF) == YAMLType::Comment)
+				{
+					continue;
+				}
+				Span none = {nullptr, 0};
+				for (size_t i = 0; i != _columns.size(); ++i)
+				{
+					_columns[i].spans.push_back(none);
+				}
+
+				// Rows usually list their keys in the same order, so the
+				// column after the last match is tried first.
+				size_t next = 0;
+				if (row->key())
+				{
+					next = field(row, next);
+				}
+				for (const Node *child = row->firstChild(); child;
+					child = child->nextSibling())
+				{
+					if (child->key())
+					{
+						next = field(child, next);
+					}
+				}
+				++_rows;
+			}
+
+			for (size_t i = 0; i != _columns.size(); ++i)
+			{
+				convert(&_columns[i]);
+			}
+			return _rows;
+		}
+
+		/*!
+		 *	Returns the number of rows extracted.
+		**/
+		inline size_t rows() const
+		{
+			return _rows;
+		}
+
+		/*!
+		 *	Returns the number of columns.
+		**/
+		inline size_t columns() const
+		{
+			return _columns.size();
+		}
+
+		/*!
+		 *	Returns the indicated column.
+		**/
+		inline const Column &column(size_t index) const
+		{
+			return _columns[index];
+		}
+
+	private:
+
+		/*!
+		 *	Stores the value of a field in its column, if it has one, and
+		 *	returns the column to try first for the next field.
+		**/
+		size_t field(const Node *node, size_t next)
+		{
+			Span key = Unicode::trim<Char>(node->key(), node->keySize());
+			size_t i = next;
+			for (size_t tried = 0; tried != _columns.size(); ++tried, ++i)
+			{
+				if (i == _columns.size())
+				{
+					i = 0;
+				}
+				Column &column = _columns[i];
+				if (column.keySize == key.size && !memcmp(column.key, key.data,
+					key.size * sizeof(CharType)))
+				{
+					Span &span = column.spans.back();
+					if (!span.data)
+					{
+						span = Unicode::trim<Char>(node->value(),
+							node->valueSize());
+						if (!span.data)
+						{
+							span.data = node->key() + node->keySize();
+						}
+					}
+					return i + 1;
+				}
+			}
+			return next;
+		}
+
+		/*!
+		 *	Converts the spans of a number column.
+		**/
+		void convert(Column *column)
+		{
+			if (column->type == Text)
+			{
+				return;
+			}
+			size_t rows = column->spans.size();
+			column->valid.assign(rows, 0);
+			if (column->type == Integer)
+			{
+				column->integers.assign(rows, 0);
+				for (size_t i = 0; i != rows; ++i)
+				{
+					const Span &span = column->spans[i];
+					column->valid[i] = Number::parseInteger(
+						ascii(span.data, span.size), span.size,
+						&column->integers[i]);
+				}
+			}
+			else
+			{
+				column->reals.assign(rows, 0.0);
+				for (size_t i = 0; i != rows; ++i)
+				{
+					const Span &span = column->spans[i];
+					column->valid[i] = Number::parseReal(
+						ascii(span.data, span.size), span.size,
+						&column->reals[i]);
+				}
+			}
+		}
+
+		/*!
+		 *	Returns number text as ASCII. UTF-8 is used as it is, and other
+		 *	encodings are narrowed into a buffer, with characters that cannot
+		 *	be part of a number replaced.
+		**/
+		const char *ascii(const char *data, size_t)
+		{
+			return data;
+		}
+
+		template <typename Other> const char *ascii(const Other *data,
+			size_t size)
+		{
+			static const char characters[] = "0123456789+-.eEinfINFaA";
+			_ascii.assign(size, '?');
+			for (size_t i = 0; i != size; ++i)
+			{
+				for (const char *ch = characters; *ch; ++ch)
+				{
+					if (Char::isChar(data[i], *ch))
+					{
+						_ascii[i] = *ch;
+						break;
+					}
+				}
+			}
+			return _ascii.c_str();
+		}
+
+		std::vector<Column> _columns;
+		size_t _rows;
+		std::string _ascii;
+	};
+
+	/*!
+	 *	A read-only view of several documents layered on top of each other,
+	 *	such as a base configuration with overlays. Nothing is copied; the
+	 *	view only keeps pointers to the nodes of each layer.
+	 *
+	 *	Mapping elements with the same key, without the spaces around it,
+	 *	are merged. The topmost layer that has the key provides the value,
+	 *	and the children of every layer that has it are merged in turn.
+	 *	Other children, such as sequence elements, are not merged; the
+	 *	topmost layer that has any of them provides all of them. Comments
+	 *	are left out. Keys keep the order of the lowest layer that has them.
+	 *
+	 *	Children are merged the first time they are needed and kept, and
+	 *	find() remembers the result for each path. The layers must not
+	 *	change while the view is used, or clear() must be called after.
+	**/
+	template <typename Char, template <typename> class Links = FullLinks>
+		struct YAMLOverlayBase
+	{
+		typedef typename Char::CharType CharType;
+		typedef YAMLNode<Char, Links> Node;
+		typedef NodeBase<Node> Base;
+
+	private:
+
+		typedef Unicode::String<CharType> StringKey;
+		typedef Hash::StringHash<CharType> StringHash;
+		typedef Hash::StringEqual<CharType> StringEqual;
+
+	public:
+
+		/*!
+		 *	A node as seen through the layers.
+		**/
+		struct Entry
+		{
+			/*!
+			 *	Returns the node from the topmost layer, or 0 for the root.
+			**/
+			inline const Node *node() const
+			{
+				return _isRoot ? nullptr :
+					static_cast<const Node*>(_layers.front());
+			}
+
+			/*!
+			 *	Returns the nodes merged into this one, topmost first.
+			**/
+			inline const std::vector<const Base*> &layers() const
+			{
+				return _layers;
+			}
+
+		private:
+			friend struct YAMLOverlayBase;
+
+			std::vector<const Base*> _layers;
+			std::vector<const Entry*> _children;
+			std::unordered_map<StringKey, const Entry*, StringHash,
+				StringEqual> _keys;
+			bool _isRoot;
+			bool _merged;
+		};
+
+		YAMLOverlayBase()
+		{
+			clear();
+		}
+
+		/*!
+		 *	Adds a document or node whose children form the next layer, on top
+		 *	of the layers added before.
+		**/
+		void addLayer(const Base *root)
+		{
+			_layerRoots.insert(_layerRoots.begin(), root);
+			clear();
+		}
+
+		/*!
+		 *	Forgets every merged entry and remembered path, for when the
+		 *	layers changed. The layers themselves are kept.
+		**/
+		void clear()
+		{
+			_entries.clear();
+			_paths.clear();
+			_pathStrings.clear();
+			_root = newEntry();
+			_root->_layers = _layerRoots;
+			_root->_isRoot = true;
+		}
+
+		/*!
+		 *	Returns the entry for the roots of the layers.
+		**/
+		inline const Entry *root() const
+		{
+			return _root;
+		}
+
+		/*!
+		 *	Returns the merged children of an entry, merging them on first use.
+		**/
+		const std::vector<const Entry*> &children(const Entry *entry)
+		{
+			return merge(entry)->_children;
+		}
+
+		/*!
+		 *	Returns the child of an entry with the indicated key, or 0 if no
+		 *	layer has one.
+		**/
+		const Entry *child(const Entry *entry, const CharType *key,
+			size_t keySize)
+		{
+			Entry *merged = merge(entry);
+			StringKey string = {key, keySize};
+			auto found = merged->_keys.find(string);
+			return found == merged->_keys.end() ? nullptr : found->second;
+		}
+
+		/*!
+		 *	Returns the entry at a path of size characters with keys split by
+		 *	separator, such as "bill-to/address/city", or 0 if there is none.
+		 *	An empty path is the root. Results, including missing paths, are
+		 *	remembered for each separator until clear() is called.
+		**/
+		const Entry *findPath(const CharType *path, size_t size,
+			char separator = '/')
+		{
+			if (!size)
+			{
+				return _root;
+			}
+			Paths &paths = _paths[separator];
+			StringKey key = {path, size};
+			auto found = paths.find(key);
+			if (found != paths.end())
+			{
+				return found->second;
+			}
+			const Entry *entry = _root;
+			size_t start = 0;
+			for (size_t i = 0; entry && i <= size; ++i)
+			{
+				if (i == size || Char::isChar(path[i], separator))
+				{
+					entry = child(entry, path + start, i - start);
+					start = i + 1;
+				}
+			}
+			// The remembered path needs its own copy.
+			CharType *copy = new CharType[size];
+			_pathStrings.push_back(std::unique_ptr<CharType[]>(copy));
+			memcpy(copy, path, size * sizeof(CharType));
+			key.data = copy;
+			paths.insert(std::make_pair(key, entry));
+			return entry;
+		}
+
+		/*!
+		 *	Returns the entry at a null terminated path. See findPath().
+		**/
+		const Entry *find(const CharType *path, char separator = '/')
+		{
+			return findPath(path, Unicode::datalen(path), separator);
+		}
+
+	private:
+
+		Entry *newEntry()
+		{
+			_entries.push_back(std::unique_ptr<Entry>(new Entry));
+			Entry *entry = _entries.back().get();
+			entry->_isRoot = false;
+			entry->_merged = false;
+			return entry;
+		}
+
+		/*!
+		 *	Merges the children of an entry's layers, lowest layer first, so
+		 *	keys keep the order they first appear in.
+		**/
+		Entry *merge(const Entry *constEntry)
+		{
+			Entry *entry = const_cast<Entry*>(constEntry);
+			if (entry->_merged)
+			{
+				return entry;
+			}
+			entry->_merged = true;
+
+			// Only the topmost layer with unmerged children provides them.
+			const Base *listLayer = nullptr;
+			for (size_t i = 0; i != entry->_layers.size() && !listLayer; ++i)
+			{
+				for (const Node *child = entry->_layers[i]->firstChild();
+					child; child = child->nextSibling())
+				{
+					if (isListed(child))
+					{
+						listLayer = entry->_layers[i];
+						break;
+					}
+				}
+			}
+
+			for (size_t i = entry->_layers.size(); i--;)
+			{
+				const Base *layer = entry->_layers[i];
+				for (const Node *child = layer->firstChild(); child;
+					child = child->nextSibling())
+				{
+					if (isListed(child))
+					{
+						if (layer == listLayer)
+						{
+							Entry *listed = newEntry();
+							listed->_layers.push_back(child);
+							entry->_children.push_back(listed);
+						}
+						continue;
+					}
+					if ((child->type() & 0xF) != YAMLType::Mapping)
+					{
+						continue;
+					}
+					StringKey key = Unicode::trim<Char>(child->key(),
+						child->keySize());
+					auto found = entry->_keys.find(key);
+					if (found == entry->_keys.end())
+					{
+						Entry *keyed = newEntry();
+						keyed->_layers.push_back(child);
+						entry->_children.push_back(keyed);
+						entry->_keys.insert(std::make_pair(key, keyed));
+					}
+					else
+					{
+						// Layers are visited from the bottom, so this one is
+						// above the ones already merged.
+						Entry *keyed = const_cast<Entry*>(found->second);
+						keyed->_layers.insert(keyed->_layers.begin(), child);
+					}
+				}
+			}
+			return entry;
+		}
+
+		/*!
+		 *	Returns whether a child is taken from a single layer instead of
+		 *	being merged by key.
+		**/
+		static bool isListed(const Node *node)
+		{
+			switch (node->type() & 0xF)
+			{
+			case YAMLType::Mapping:
+			case YAMLType::Comment:
+				return false;
+			}
+			return true;
+		}
+
+		typedef std::unordered_map<StringKey, const Entry*, StringHash,
+			StringEqual> Paths;
+
+		std::vector<const Base*> _layerRoots;	// Topmost first.
+		std::vector<std::unique_ptr<Entry>> _entries;
+		std::unordered_map<char, Paths> _paths;	// By separator.
+		std::vector<std::unique_ptr<CharType[]>> _pathStrings;
+		Entry *_root;
+	};
+
+	typedef YAMLOverlayBase<Unicode::CharUTF8> YAMLOverlayUTF8;
+
+	/*!
+	 *	A generic class that allocates data from a memory pool for a single node
+	 *	type. Data is preallocated in bytes, with the total number of bytes
+	 *	equalling the indicated StaticPoolSize as stack memory. When it runs out
+	 *	memory will begin to be placed on the heap whose size is indicated by
+	 *	DynamicPoolSize.
+	**/
+	template <typename NodeType, size_t StaticPoolSize,
+			  size_t DynamicPoolSize> struct MemoryPool
+	{
+		/*!
+		 *	Creates a memory pool.
+		**/
+		MemoryPool() : _memoryFirst(0), _memorySpare(0), _memoryFree(0),
+			_memoryPosition((char*)_memoryStatic),
+			_memoryEnd(_memoryPosition + StaticPoolSize) {}
+		
+		/*!
+		 *	Clears all internal data.
+		**/
+		~MemoryPool()
+		{
+			clear();
+		}
+		
+	protected:
+	
+		/*!
+		 *	Returns the next available free space, creating it if it does not
+		 *	exist.
+		**/
+		void *allocate()
+		{
+			if (_memoryFree)
+			{
+				char *position = _memoryFree;
+				memcpy(&_memoryFree, position, sizeof(void*));
+				return position;
+			}
+			void *position = _memoryPosition;
+			if (_memoryPosition + sizeof(NodeType) > _memoryEnd)
+			{
+				char *block = _memorySpare;
+				if (block)
+				{
+					memcpy(&_memorySpare, block, sizeof(void*));
+				}
+				else
+				{
+					block = new char[DynamicPoolSize];
+				}
+				memcpy(block, &_memoryFirst, sizeof(void*));
+				_memoryFirst = block;
+				_memoryEnd = block + DynamicPoolSize;
+				_memoryPosition = block + sizeof(void*);
+				position = _memoryPosition;
+			}
+			_memoryPosition += sizeof(NodeType);
+			return position;
+		}
+
+		/*!
+		 *	Makes the space of a single node available to the next allocate().
+		**/
+		void release(void *memory)
+		{
+			memcpy(memory, &_memoryFree, sizeof(void*));
+			_memoryFree = static_cast<char*>(memory);
+		}
+		
+		/*!
+		 *	Makes all memory available again. Dynamic memory blocks are kept
+		 *	and reused before any new block is allocated.
+		**/
+		void rewind()
+		{
+			while (_memoryFirst)
+			{
+				char *next;
+				memcpy(&next, _memoryFirst, sizeof(void*));
+				memcpy(_memoryFirst, &_memorySpare, sizeof(void*));
+				_memorySpare = _memoryFirst;
+				_memoryFirst = next;
+			}
+			_memoryFree = nullptr;
+			_memoryPosition = _memoryStatic;
+			_memoryEnd = _memoryPosition + StaticPoolSize;
+		}
+		
+		/*!
+		 *	Clears all stored dynamic memory blocks.
+		**/
+		void clear()
+		{
+			rewind();
+			if (_memorySpare)
+			{
+				void *location = _memorySpare;
+				while (location)
+				{
+					memcpy(&location, _memorySpare, sizeof(void*));
+					delete[] _memorySpare;
+					_memorySpare = static_cast<char*>(location);
+				}
+			}
+		}
+		
+	private:
+		
+		char _memoryStatic[StaticPoolSize];
+		char *_memoryFirst;			// Current memory block first position.
+		char *_memorySpare;			// Unused memory blocks kept for reuse.
+		char *_memoryFree;			// Released nodes, linked through their
+									// first bytes.
+		char *_memoryPosition;		// Free memory position.
+		char *_memoryEnd;			// Memory not allowed to write.
+	};
+	
+	/*!
+	 *	A generic class that copies strings into blocks of BlockSize bytes,
+	 *	one after another. Blocks are only allocated once a string is copied.
+	**/
+	template <typename CharType, size_t BlockSize> struct StringPool
+	{
+		/*!
+		 *	Creates a string pool.
+		**/
+		StringPool() : _stringFirst(0), _stringSpare(0), _stringPosition(0),
+			_stringEnd(0) {}
+
+		/*!
+		 *	Clears all internal data.
+		**/
+		~StringPool()
+		{
+			clearStrings();
+		}
+
+	protected:
+
+		/*!
+		 *	Returns a copy of the indicated string. The copy is not null
+		 *	terminated.
+		**/
+		const CharType *allocateString(const CharType *string, size_t size)
+		{
+			if (!_stringPosition ||
+				size > static_cast<size_t>(_stringEnd - _stringPosition))
+			{
+				addBlock(size);
+			}
+			CharType *copy = _stringPosition;
+			if (size)
+			{
+				memcpy(copy, string, size * sizeof(CharType));
+			}
+			_stringPosition += size;
+			return copy;
+		}
+
+		/*!
+		 *	Makes all strings available again. Blocks are kept and reused
+		 *	before any new block is allocated.
+		**/
+		void rewindStrings()
+		{
+			while (_stringFirst)
+			{
+				Block *next = _stringFirst->next;
+				_stringFirst->next = _stringSpare;
+				_stringSpare = _stringFirst;
+				_stringFirst = next;
+			}
+			_stringPosition = 0;
+			_stringEnd = 0;
+		}
+
+		/*!
+		 *	Clears all stored blocks.
+		**/
+		void clearStrings()
+		{
+			rewindStrings();
+			while (_stringSpare)
+			{
+				Block *next = _stringSpare->next;
+				delete[] reinterpret_cast<char*>(_stringSpare);
+				_stringSpare = next;
+			}
+		}
+
+	private:
+
+		struct Block
+		{
+			Block *next;
+			size_t size;			// Characters after this header.
+		};
+
+		/*!
+		 *	Makes a block with room for at least size characters current,
+		 *	taking it from the spare blocks if one is large enough.
+		**/
+		void addBlock(size_t size)
+		{
+			Block **spare = &_stringSpare;
+			while (*spare && (*spare)->size < size)
+			{
+				spare = &(*spare)->next;
+			}
+			Block *block = *spare;
+			if (block)
+			{
+				*spare = block->next;
+			}
+			else
+			{
+				size_t fit = (BlockSize - sizeof(Block)) / sizeof(CharType);
+				size = size > fit ? size : fit;
+				block = reinterpret_cast<Block*>(
+					new char[sizeof(Block) + size * sizeof(CharType)]);
+				block->size = size;
+			}
+			block->next = _stringFirst;
+			_stringFirst = block;
+			_stringPosition = reinterpret_cast<CharType*>(block + 1);
+			_stringEnd = _stringPosition + block->size;
+		}
+
+		Block *_stringFirst;		// Current block.
+		Block *_stringSpare;		// Unused blocks kept for reuse.
+		CharType *_stringPosition;	// Free string position.
+		CharType *_stringEnd;		// Memory not allowed to write.
+	};
+
+	/*!
+	 *	Represents a YAML document.
+	**/
+	template <typename Char, template <typename> class Links>
+		struct YAMLDocumentBase :
+		public MemoryPool<YAMLNode<Char, Links>, SIPYAML_STATIC_POOL_SIZE,
+		SIPYAML_DYNAMIC_POOL_SIZE>,
+		public StringPool<typename Char::CharType, SIPYAML_STRING_POOL_SIZE>,
+		public NodeBase<YAMLNode<Char, Links>>
+	{
+		typedef typename Char::CharType CharType;
+		typedef YAMLNode<Char, Links> Node;
+
+		/*!
+		 *	Creates an empty document.
+		**/
+		YAMLDocumentBase() : _text(0), _internKeys(false) {}
+	
+		/*!
+		 *	Creates and returns a new YAML node. This node is automatically
+		 *	deleted when the document is deleted.
+		**/
+		Node *allocateNode(YAMLType type, const CharType *key = 0,
+			size_t keySize = 0, const CharType *value = 0, size_t valueSize = 0)
+		{
+			Node *node = new(this->allocate()) Node(type, 
+				key, keySize, value, valueSize);
+			return node;
+		}
+		
+		/*!
+		 *	Removes every node and restores the settings of a new document,
+		 *	so that the document can be used again. Memory is kept for the
+		 *	next nodes and strings rather than freed, but text kept with
+		 *	keepText() is freed.
+		**/
+		void reset()
+		{
+			this->clearChildren();
+			this->rewind();
+			this->rewindStrings();
+			_interned.clear();
+			_kept.clear();
+			_text = 0;
+			_internKeys = false;
+		}
+
+		/*!
+		 *	Returns a copy of the indicated string that is owned by the
+		 *	document. Like node strings, the copy is not null terminated.
+		 *	Empty strings all share one static string, so they never take a
+		 *	block from the pool.
+		**/
+		const CharType *copyString(const CharType *string, size_t size)
+		{
+			static const CharType empty[1] = {};
+			return size ? this->allocateString(string, size) : empty;
+		}
+
+		/*!
+		 *	Returns a copy of the indicated string that is owned by the
+		 *	document and shared by every equal interned string, so interned
+		 *	strings can be compared by pointer.
+		**/
+		const CharType *internString(const CharType *string, size_t size)
+		{
+			StringKey key = {string, size};
+			typename Interned::iterator found = _interned.find(key);
+			if (found != _interned.end())
+			{
+				return found->data;
+			}
+			key.data = copyString(string, size);
+			_interned.insert(key);
+			return key.data;
+		}
+
+		/*!
+		 *	Sets whether setKey() interns the keys it copies. This is off by
+		 *	default.
+		**/
+		void setInternKeys(bool intern)
+		{
+			_internKeys = intern;
+		}
+
+		/*!
+		 *	Sets a node's key to a copy owned by the document, so the
+		 *	indicated key does not have to outlive it.
+		**/
+		void setKey(Node *node, const CharType *key, size_t size)
+		{
+			node->setKey(_internKeys ? internString(key, size) :
+				copyString(key, size), size);
+		}
+
+		void setKey(Node *node, const CharType *key)
+		{
+			setKey(node, key, Unicode::datalen(key));
+		}
+
+		/*!
+		 *	Sets a node's value to a copy owned by the document.
+		**/
+		void setValue(Node *node, const CharType *value, size_t size)
+		{
+			node->setValue(copyString(value, size), size);
+		}
+
+		void setValue(Node *node, const CharType *value)
+		{
+			setValue(node, value, Unicode::datalen(value));
+		}
+		
+		/*!
+		 *	Prints a readable YAML file representation, without comments.
+		**/
+		void print(std::string *printer) const
+		{
+			Print::printYAMLChildren(printer, this);
+		}
+
+		/*!
+		 *	Prints the document as it was parsed, with only the nodes changed
+		 *	since then printed again. See Print::printYAMLRoundTrip().
+		**/
+		void printRoundTrip(std::string *printer) const
+		{
+			Print::printYAMLRoundTrip(printer, this);
+		}
+
+#ifdef SIPYAML_THREADS
+		/*!
+		 *	Prints the same representation as print(), rendering top level
+		 *	nodes on up to the indicated number of threads, or one per
+		 *	hardware thread if 0.
+		**/
+		void print(std::string *printer, size_t threads) const
+		{
+			Print::printYAMLChildrenParallel(printer, this, 0, threads);
+		}
+#endif // SIPYAML_THREADS
+
+		/*!
+		 *	Returns a hash of every node in the document. See YAMLDiff.
+		**/
+		uint64_t hash() const
+		{
+			return YAMLDiff<Char, Links>::hash(this);
+		}
+
+		/*!
+		 *	Appends a document image to image. Returns false if the document
+		 *	is too large for an image. See YAMLImageBase.
+		**/
+		bool writeImage(std::string *image, uint64_t sourceSize = 0,
+			int64_t sourceTime = 0) const
+		{
+			return ImageWriter<Char>::write(image, this, sourceSize,
+				sourceTime);
+		}
+		
+		/*!
+		 *	Parses a YAML file.
+		**/
 		void parse(const CharType *yaml)
 		{
-			size_t position = 0;
-			size_t indent =  0;
-			YAMLNode<Char> *node;
-			NodeBase<YAMLNode<Char>> *inserting = this;
-			
-			stack<size_t> indents;
-			indents.push(0);
-			
-			while (1)
+			ParseState state(this, 0);
+			_text = yaml;
+			parseLines(yaml, 0, static_cast<size_t>(-1), &state);
+		}
+
+		/*!
+		 *	Parses a YAML file, checking that it is valid text in the
+		 *	document's encoding. Lines are checked in small blocks right
+		 *	after they are scanned, while they are still in the cache, so the
+		 *	text is only read from memory once. Returns false and sets
+		 *	invalidOffset to the byte offset of the first invalid character
+		 *	if the text is not valid. The document is then only partially
+		 *	parsed.
+		**/
+		bool parse(const CharType *yaml, size_t *invalidOffset)
+		{
+			ParseState state(this, 0);
+			_text = yaml;
+			return parseLines(yaml, 0, static_cast<size_t>(-1), &state,
+				invalidOffset);
+		}
+
+		/*!
+		 *	Updates the document after the text it was parsed from has been
+		 *	edited, so that removedSize characters at offset were replaced by
+		 *	insertedSize characters. yaml is the entire text after the edit and
+		 *	may be the same buffer edited in place.
+		 *
+		 *	Only the edited lines and their enclosing indentation block are
+		 *	parsed again, and the new nodes are spliced into the tree. Nodes
+		 *	after the edit keep their structure, but node strings are plain
+		 *	pointers, so each of them is still visited to shift its strings,
+		 *	and every node is visited if yaml is a new buffer. Parsing is
+		 *	proportional to the edit, but unless the edit is in place and
+		 *	keeps the length of the text, the whole call is O(n) in the nodes
+		 *	after the edit. If the edit changes the indentation around the
+		 *	block, or the document was not parsed, the whole text is parsed
+		 *	instead.
+		 *
+		 *	Replaced nodes go back to the pool and are reused for later nodes,
+		 *	so pointers to them must not be kept. Strings the document copied
+		 *	for them are kept until reset().
+		**/
+		void reparse(const CharType *yaml, size_t offset, size_t removedSize,
+			size_t insertedSize)
+		{
+			const CharType *old = _text;
+			ptrdiff_t delta = static_cast<ptrdiff_t>(insertedSize) -
+				static_cast<ptrdiff_t>(removedSize);
+
+			// Affected lines. The text before offset has not changed.
+			size_t first = offset;
+			while (first && !Char::isChar(yaml[first - 1], '\n'))
+			{
+				--first;
+			}
+			size_t last = offset + insertedSize;
+			while (notEndLine(yaml[last]))
+			{
+				++last;
+			}
+			size_t lastOld = last - delta;
+			size_t minIndent = static_cast<size_t>(-1);
+			for (size_t position = first; position <= last;)
+			{
+				size_t indent = indentAt(yaml, position);
+				minIndent = indent < minIndent ? indent : minIndent;
+				position += indent;
+				while (notEndLine(yaml[position]))
+				{
+					++position;
+				}
+				++position;
+			}
+
+			// Find the deepest run of siblings covering every affected line.
+			NodeBase<Node> *parent = this;
+			size_t baseIndent = 0;
+			Node *begin = nullptr;
+			Node *end = nullptr;
+			while (old)
+			{
+				begin = nullptr;
+				end = nullptr;
+				Node *child = parent->firstChild();
+				for (; child && child->line(); child = child->nextSibling())
+				{
+					if (static_cast<size_t>(child->line() - old) > lastOld)
+					{
+						break;
+					}
+					if (rangeEnd(child, old) >= first)
+					{
+						begin = begin ? begin : child;
+						end = child;
+					}
+				}
+				if (!begin || (child && !child->line()))
+				{
+					old = nullptr;
+					break;
+				}
+
+				// Descend if the edit is below the node's own line and keeps
+				// the indentation of its children.
+				Node *inner = begin->firstChild();
+				while (inner && inner->line() == begin->line())
+				{
+					inner = inner->nextSibling();
+				}
+				if (begin != end || !inner || !inner->line() ||
+					static_cast<size_t>(inner->line() - old) >= first ||
+					static_cast<size_t>(begin->line() - old) +
+					begin->lineSize() >= first || rangeEnd(begin, old) < lastOld)
+				{
+					break;
+				}
+				size_t indent = indentAt(yaml, inner->line() - old);
+				if (minIndent < indent)
+				{
+					break;
+				}
+				parent = begin;
+				baseIndent = indent;
+			}
+
+			// The block must still start at, and never leave, its indentation,
+			// and the line after it must not become part of it.
+			size_t start = old ? begin->line() - old : 0;
+			size_t stopOld = 0;
+			if (old)
+			{
+				stopOld = rangeEnd(end, old);
+				stopOld = stopOld > lastOld ? stopOld : lastOld;
+				if (indentAt(yaml, start) != baseIndent ||
+					(Char::isChar(yaml[stopOld + delta], '\n') &&
+					indentAt(yaml, stopOld + delta + 1) > baseIndent))
+				{
+					old = nullptr;
+				}
+				for (size_t position = start; old && position <= stopOld +
+					delta;)
+				{
+					size_t indent = indentAt(yaml, position);
+					if (indent < baseIndent)
+					{
+						old = nullptr;
+					}
+					position += indent;
+					while (notEndLine(yaml[position]))
+					{
+						++position;
+					}
+					++position;
+				}
+			}
+			if (!old)
+			{
+				reset();
+				parse(yaml);
+				return;
+			}
+
+			// Shift every node outside of the block, skipping the block. An
+			// edit in place that keeps the length moves nothing.
+			Node *node = yaml == old && !delta ? nullptr : end;
+			if (yaml != old)
+			{
+				node = this->firstChild();
+				if (node == begin)
+				{
+					node = end;
+				}
+			}
+			while (node)
+			{
+				if (node == end)
+				{
+					node = nextSubtree(node);
+					continue;
+				}
+				// Strings set by hand are not in the node's line and are kept.
+				if (inLine(node->_key, node))
+				{
+					node->_key = shift(node->_key, old, yaml, stopOld, delta);
+				}
+				if (inLine(node->_value, node))
+				{
+					node->_value = shift(node->_value, old, yaml, stopOld,
+						delta);
+				}
+				node->_line = shift(node->_line, old, yaml, stopOld, delta);
+				if (node->firstChild())
+				{
+					node = node->firstChild();
+				}
+				else
+				{
+					node = nextSubtree(node);
+				}
+				if (node == begin)
+				{
+					node = end;
+				}
+			}
+
+			// Replace the block.
+			struct Block : public NodeBase<Node> {} block;
+			ParseState state(&block, baseIndent);
+			parseLines(yaml, start, stopOld + delta, &state);
+			Node *after = end->nextSibling();
+			for (Node *next = begin; next != after;)
+			{
+				node = next;
+				next = next->nextSibling();
+				parent->removeNode(node);
+				releaseNode(node);
+			}
+			while ((node = block.firstChild()))
+			{
+				block.removeNode(node);
+				parent->insertNode(node, after);
+				node->_inserted = false;
+			}
+			_text = yaml;
+		}
+
+	protected:
+
+		/*!
+		 *	Returns the memory of a detached node and its children to the
+		 *	pool.
+		**/
+		void releaseNode(Node *node)
+		{
+			PostOrderIterator<Node> child(node);
+			PostOrderIterator<Node> end;
+			while (child != end)
+			{
+				Node *released = &*child;
+				++child;
+				this->release(released);
+			}
+			this->release(node);
+		}
+
+		/*!
+		 *	Where parsing continues. indents holds the indentation of
+		 *	inserting and its parents, and lasts holds the last node added at
+		 *	each of those levels, so adding a node never walks the siblings.
+		**/
+		struct ParseState
+		{
+			ParseState(NodeBase<Node> *root, size_t indent) : inserting(root)
+			{
+				if (!root->firstChild())
+				{
+					root->_dirty = false;
+				}
+				else
+				{
+					// The new text does not follow the old in memory.
+					root->lastChild()->invalidate();
+				}
+				indents.push(indent);
+				lasts.push(root->lastChild());
+			}
+
+			NodeBase<Node> *inserting;
+			stack<size_t> indents;
+			stack<Node*> lasts;
+		};
+
+		/*!
+		 *	Marks the nodes that later lines can still be added below as
+		 *	changed. Called when the next lines do not follow the last ones in
+		 *	memory, so a round trip print does not copy across the gap.
+		**/
+		void breakText(ParseState *state)
+		{
+			if (state->lasts.top())
+			{
+				state->lasts.top()->invalidate();
+			}
+			else
+			{
+				state->inserting->invalidate();
+			}
+		}
+
+		// Characters scanned between validation calls, small enough to stay
+		// in the cache.
+		static const size_t ValidateBlock = 2048;
+
+		/*!
+		 *	Parses the lines from position up to and including the line that
+		 *	contains end, continuing from the indicated state. If invalid is
+		 *	not 0, the scanned lines are validated every ValidateBlock
+		 *	characters and parsing stops at the first invalid block,
+		 *	returning false.
+		**/
+		bool parseLines(const CharType *yaml, size_t position, size_t end,
+			ParseState *state, size_t *invalid = nullptr)
+		{
+			size_t indent =  0;
+			size_t lineStart;
+			Node *node;
+			NodeBase<Node> *&inserting = state->inserting;
+			stack<size_t> &indents = state->indents;
+			stack<Node*> &lasts = state->lasts;
+			size_t checked = position;
+			
+			while (position <= end)
+			{
+				if (Char::isChar(yaml[position], '\0'))
+				{
+					break;
+				}
+				node = nullptr;
+				lineStart = position;
+				indent = 0;
+				while (Char::isChar(yaml[position], ' '))
+				{
+					indent += 1;
+					++position;
+				}
+				if (Char::isChar(yaml[position], '\0'))
+				{
+					break;
+				}
+
+				if (Char::isChar(yaml[position], '-'))
+				{
+					if (Char::isChar(yaml[position + 1], '-') &&
+						Char::isChar(yaml[position + 2], '-'))
+					{
+						node = allocateNode(Sip::Begin);
+						position += 3;
+					}
+					else if (Char::isChar(yaml[position + 1], ' '))
+					{
+						// Read key/value.
+						node = allocateNode(Sip::Sequence, 0, 0,
+							&yaml[++position]);
+						while (notEndText(yaml[position]) &&
+							notEndKey(&yaml[++position])) {}
+						// TODO: Check key size.
+						if (isKeyChar(&yaml[position]))
+						{
+							// Both scalar and key.
+							node->setKey(node->value(),
+								&yaml[position] - node->value() - 1);
+							node->setValue(&yaml[position], 0);
+							while (notEndText(yaml[position]) &&
+								notEnd(yaml[++position])) {}
+							// TODO: Check value size.
+							node->setValue(node->value(),
+								&yaml[position] - node->value());
+						}
+						else
+						{
+							// Only scalar, no key.
+							node->setValue(node->value(),
+								&yaml[position] - node->value());
+						}
+					}
+					else
+					{
+						// TODO: This should go parse maps.
+					}
+				}
+				else if (Char::isChar(yaml[position], '.') &&
+					Char::isChar(yaml[position + 1], '.') &&
+					Char::isChar(yaml[position + 2], '.'))
+				{
+					node = allocateNode(Sip::End);
+					position += 3;
+				}
+				else if (!Char::isChar(yaml[position], '#'))
+				{
+					// Map Elements processing.
+					node = allocateNode(Sip::Mapping, &yaml[position], 0);
+					while (notEndKey(&yaml[++position])) {}
+					if (!isKeyChar(&yaml[position]))
+					{
+						cout << "ERROR!";
+						// TODO: Error, expected key.
+					}
+					node->setKey(node->key(),
+						&yaml[position] - node->key() - 1);
+					while (notEndText(yaml[position]) &&
+						isWhitespace(yaml[++position])) {}
+					node->setValue(&yaml[position], 0);
+					while (notEndText(yaml[position]) &&
+						notEnd(yaml[++position])) {}
+					node->setValue(node->value(),
+						&yaml[position] - node->value());
+				}
+				
+				// Checks for comment. Otherwise, skips newline.
+				if (Char::isChar(yaml[position], '#'))
+				{
+					++position;
+					Node *commentNode =
+						allocateNode(Sip::Comment, 0, 0, &yaml[position]);
+					while (!Char::isChar(yaml[position], '\n') &&
+							yaml[position] != 0)
+					{
+						++position;
+					}
+					commentNode->setValue(commentNode->value(),
+						&yaml[position] - commentNode->value());
+					if (node)
+					{
+						//node->setType(Sip::Inline);
+						node->appendNode(commentNode);
+					}
+					else
+					{
+						node = commentNode;
+					}
+				}
+				if (invalid && position - checked >= ValidateBlock)
+				{
+					size_t valid = Char::validate(&yaml[checked],
+						position - checked);
+					if (valid != position - checked)
+					{
+						*invalid = (checked + valid) * sizeof(CharType);
+						return false;
+					}
+					checked = position;
+				}
+				if (node)
+				{
+					node->setLine(&yaml[lineStart], position - lineStart);
+					node->_modified = false;
+					node->_dirty = false;
+					if (node->firstChild())
+					{
+						node->firstChild()->setLine(node->line(),
+							node->lineSize());
+						node->firstChild()->_modified = false;
+						node->firstChild()->_dirty = false;
+						node->firstChild()->_inserted = false;
+					}
+				}
+				if (!Char::isChar(yaml[position], '\0'))
+				{
+					++position;
+				}
+
+				// Add new parent.
+				if (indent == indents.top())
+				{
+					inserting->link(lasts.top(), node);
+					lasts.top() = node;
+				}
+				else if (indent > indents.top())
+				{
+					inserting = lasts.top();
+					inserting->link(inserting->lastChild(), node);
+					indents.push(indent);
+					lasts.push(node);
+				}
+				else
+				{
+					while (indent < indents.top())
+					{
+						inserting = inserting->parent();
+						indents.pop();
+						lasts.pop();
+					}
+					if (indent != indents.top())
+					{
+						// TODO: Error, wrong indent level.
+					}
+					inserting->link(lasts.top(), node);
+					lasts.top() = node;
+				}
+				node = nullptr;
+			}
+			if (invalid)
+			{
+				size_t valid = Char::validate(&yaml[checked], position - checked);
+				if (valid != position - checked)
+				{
+					*invalid = (checked + valid) * sizeof(CharType);
+					return false;
+				}
+			}
+			return true;
+		}
+
+	private:
+
+		/*!
+		 *	Returns the position of the last character of the indicated node's
+		 *	subtree, which ends where the next sibling begins.
+		**/
+		static size_t rangeEnd(const Node *node, const CharType *yaml)
+		{
+			if (node->nextSibling() && node->nextSibling()->line())
+			{
+				return node->nextSibling()->line() - yaml - 1;
+			}
+			while (node->lastChild())
+			{
+				node = node->lastChild();
+			}
+			return node->line() - yaml + node->lineSize();
+		}
+
+		/*!
+		 *	Returns the node following the indicated node's subtree, or 0 if it
+		 *	is the last subtree of the document.
+		**/
+		Node *nextSubtree(Node *node) const
+		{
+			while (!node->nextSibling())
+			{
+				node = node->parent();
+				if (node == static_cast<const NodeBase<Node>*>(this))
+				{
+					return nullptr;
+				}
+			}
+			return node->nextSibling();
+		}
+
+		/*!
+		 *	Moves a string from the old text into the new text, where text at
+		 *	or after stop moved by delta.
+		**/
+		static inline const CharType *shift(const CharType *string,
+			const CharType *old, const CharType *yaml, size_t stop,
+			ptrdiff_t delta)
+		{
+			if (!string)
+			{
+				return string;
+			}
+			size_t position = string - old;
+			return yaml + position + (position >= stop ? delta : 0);
+		}
+
+		static inline bool inLine(const CharType *string, const Node *node)
+		{
+			return string && node->line() && string >= node->line() &&
+				string <= node->line() + node->lineSize();
+		}
+
+		static inline size_t indentAt(const CharType *yaml, size_t position)
+		{
+			size_t indent = 0;
+			while (Char::isChar(yaml[position + indent], ' '))
+			{
+				++indent;
+			}
+			return indent;
+		}
+
+		static inline bool notEndLine(const CharType ch)
+		{
+			return !(Char::isChar(ch, '\0') || Char::isChar(ch, '\n'));
+		}
+
+		typedef Unicode::String<CharType> StringKey;
+		typedef Hash::StringHash<CharType> StringHash;
+		typedef Hash::StringEqual<CharType> StringEqual;
+
+		typedef std::unordered_set<StringKey, StringHash, StringEqual> Interned;
+
+		const CharType *_text;		// The text that was last parsed.
+		Interned _interned;			// Strings returned by internString().
+		bool _internKeys;
+
+	protected:
+
+		/*!
+		 *	Keeps the indicated text alive until the document is reset or
+		 *	destroyed, for documents that parse text they own.
+		**/
+		void keepText(std::unique_ptr<CharType[]> text)
+		{
+			_kept.push_back(std::move(text));
+		}
+
+	private:
+
+		std::vector<std::unique_ptr<CharType[]>> _kept;
+		
+		/*!
+		 *	Returns false at the terminator, which scanning must not pass.
+		**/
+		static inline bool notEndText(const CharType ch)
+		{
+			return !Char::isChar(ch, '\0');
+		}
+
+		static inline bool notEnd(const CharType ch)
+		{
+			return !(Char::isChar(ch, '\0') || Char::isChar(ch, '\n') ||
+					Char::isChar(ch, '#'));
+		}
+		
+		static inline bool isKeyChar(const CharType *ch)
+		{
+			return (Char::isChar(*ch, ' ') && Char::isChar(*(ch - 1), ':'));
+		}
+		
+		static inline bool notEndKey(const CharType *ch)
+		{
+			return notEnd(*ch) && !isKeyChar(ch);
+		}
+		
+		static inline bool isWhitespace(const CharType ch)
+		{
+			return Char::isChar(ch, ' ') || Char::isChar(ch, '\t');
+		}
+	};
+
+	struct YAMLDocumentUTF8 : public YAMLDocumentBase<Unicode::CharUTF8> {};
+	struct YAMLDocumentUTF16 : public YAMLDocumentBase<Unicode::CharUTF8> {};
+#ifndef SIPYAML_BIG_ENDIAN
+	typedef YAMLDocumentUTF16 YAMLDocumentUTF16LE;
+	struct YAMLDocumentUTF16BE :
+		public YAMLDocumentBase<Unicode::CharUTF16Inverse> {};
+#else
+	typedef YAMLDocumentUTF16 YAMLDocumentUTF16BE;
+	struct YAMLDocumentUTF16LE :
+		public YAMLDocumentBase<Unicode::CharUTF16Inverse> {};
+#endif
+	struct YAMLForwardDocumentUTF8 :
+		public YAMLDocumentBase<Unicode::CharUTF8, ForwardLinks> {};
+
+#ifdef SIPYAML_MMAP
+	// Generic file functions.
+	namespace File
+	{
+		/*!
+		 *	Stores the size and modification time, in nanoseconds, of the
+		 *	indicated file. Returns false if the file does not exist.
+		**/
+		inline bool status(const char *path, uint64_t *size, int64_t *time)
+		{
+			struct stat info;
+			if (stat(path, &info) != 0)
+			{
+				return false;
+			}
+			*size = static_cast<uint64_t>(info.st_size);
+#ifdef __APPLE__
+			*time = static_cast<int64_t>(info.st_mtimespec.tv_sec) *
+				1000000000 + info.st_mtimespec.tv_nsec;
+#else
+			*time = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 +
+				info.st_mtim.tv_nsec;
+#endif // __APPLE__
+			return true;
+		}
+
+		/*!
+		 *	Reads an entire file into data, followed by a null character so
+		 *	that it can be parsed directly. Returns false on failure.
+		**/
+		template <typename CharType> bool read(const char *path,
+			std::vector<CharType> *data)
+		{
+			FILE *file = fopen(path, "rb");
+			if (!file)
+			{
+				return false;
+			}
+			data->clear();
+			CharType buffer[4096];
+			size_t count;
+			while ((count = fread(buffer, sizeof(CharType), 4096, file)) != 0)
+			{
+				data->insert(data->end(), buffer, buffer + count);
+			}
+			bool success = !ferror(file);
+			fclose(file);
+			data->push_back(0);
+			return success;
+		}
+
+		/*!
+		 *	Replaces the indicated file with data. The data is written to a
+		 *	temporary file first, so readers never see a partial file.
+		**/
+		inline bool write(const char *path, const std::string &data)
+		{
+			std::string temporary(path);
+			temporary.append(".tmp");
+			FILE *file = fopen(temporary.c_str(), "wb");
+			if (!file)
+			{
+				return false;
+			}
+			bool success = fwrite(data.data(), 1, data.size(), file) ==
+				data.size();
+			success = (fclose(file) == 0) && success;
+			if (!success || rename(temporary.c_str(), path) != 0)
+			{
+				remove(temporary.c_str());
+				return false;
+			}
+			return true;
+		}
+
+		/*!
+		 *	A read-only memory mapping of an entire file.
+		**/
+		struct Mapping
+		{
+			Mapping() : _data(nullptr), _size(0) {}
+
+			/*!
+			 *	Unmaps the file.
+			**/
+			~Mapping()
+			{
+				close();
+			}
+
+			/*!
+			 *	Maps the indicated file. Returns false if the file does not
+			 *	exist, is empty or could not be mapped.
+			**/
+			bool open(const char *path)
+			{
+				close();
+				int file = ::open(path, O_RDONLY);
+				if (file < 0)
+				{
+					return false;
+				}
+				struct stat info;
+				if (fstat(file, &info) != 0 || info.st_size <= 0)
+				{
+					::close(file);
+					return false;
+				}
+				void *data = mmap(nullptr, info.st_size, PROT_READ,
+					MAP_PRIVATE, file, 0);
+				::close(file);
+				if (data == MAP_FAILED)
+				{
+					return false;
+				}
+				_data = static_cast<const char*>(data);
+				_size = static_cast<size_t>(info.st_size);
+				return true;
+			}
+
+			/*!
+			 *	Unmaps the file, if one is mapped.
+			**/
+			void close()
+			{
+				if (_data)
+				{
+					munmap(const_cast<char*>(_data), _size);
+					_data = nullptr;
+					_size = 0;
+				}
+			}
+
+			/*!
+			 *	Returns the mapped data, or 0 if nothing is mapped.
+			**/
+			inline const char *data() const
+			{
+				return _data;
+			}
+
+			/*!
+			 *	Returns the size of the mapped data, in bytes.
+			**/
+			inline size_t size() const
+			{
+				return _size;
+			}
+
+		private:
+			Mapping(const Mapping &);
+			Mapping &operator=(const Mapping &);
+
+			const char *_data;
+			size_t _size;
+		};
+	}
+
+	/*!
+	 *	A read-only document loaded from a document image. Loading a valid image
+	 *	requires no parsing and no allocation per node; nodes are read directly
+	 *	from the memory mapped file.
+	**/
+	template <typename Char> struct YAMLImageBase
+	{
+		typedef typename Char::CharType CharType;
+		typedef YAMLImageNode<Char> Node;
+
+		YAMLImageBase() : _header(nullptr) {}
+
+		/*!
+		 *	Loads the document image for the indicated source file. If the
+		 *	image is missing, damaged or older than the source, the source is
+		 *	parsed instead and the image is rewritten. Returns false if neither
+		 *	could be read, or if the source is too large for an image.
+		**/
+		bool open(const char *source, const char *image)
+		{
+			uint64_t size;
+			int64_t time;
+			if (!File::status(source, &size, &time))
+			{
+				return load(image);
+			}
+			if (load(image) && _header->sourceSize == size &&
+				_header->sourceTime == time)
+			{
+				return true;
+			}
+			close();
+
+			std::vector<CharType> text;
+			if (!File::read(source, &text))
+			{
+				return false;
+			}
+			std::unique_ptr<YAMLDocumentBase<Char>> document(
+				new YAMLDocumentBase<Char>());
+			document->parse(text.data());
+			if (!document->writeImage(&_buffer, size, time))
+			{
+				_buffer.clear();
+				return false;
+			}
+			_header = validate(_buffer.data(), _buffer.size());
+			File::write(image, _buffer);
+			return true;
+		}
+
+		/*!
+		 *	Memory maps the indicated document image without checking whether
+		 *	it is stale. Returns false if the image is missing or damaged.
+		**/
+		bool load(const char *image)
+		{
+			close();
+			if (!_mapping.open(image))
+			{
+				return false;
+			}
+			_header = validate(_mapping.data(), _mapping.size());
+			if (!_header)
+			{
+				_mapping.close();
+				return false;
+			}
+			return true;
+		}
+
+		/*!
+		 *	Releases the document image.
+		**/
+		void close()
+		{
+			_header = nullptr;
+			_mapping.close();
+			_buffer.clear();
+		}
+
+		/*!
+		 *	Returns true if the document image is memory mapped, or false if
+		 *	it was parsed from the source file.
+		**/
+		inline bool isMapped() const
+		{
+			return _header && _mapping.data();
+		}
+
+		/*!
+		 *	Returns the root node, whose children are the document nodes, or 0
+		 *	if no image is loaded.
+		**/
+		inline const Node *root() const
+		{
+			return _header ? reinterpret_cast<const Node*>(_header + 1) :
+				nullptr;
+		}
+
+		/*!
+		 *	Returns the first document node, or 0 if there are none.
+		**/
+		inline const Node *firstChild() const
+		{
+			return _header ? root()->firstChild() : nullptr;
+		}
+
+		/*!
+		 *	Returns the last document node, or 0 if there are none.
+		**/
+		inline const Node *lastChild() const
+		{
+			return _header ? root()->lastChild() : nullptr;
+		}
+
+	private:
+
+		/*!
+		 *	Returns the header if the indicated data is a complete image of
+		 *	this character type, otherwise 0. Only the header and the node
+		 *	table are checked, see Image::checksum().
+		**/
+		static const YAMLImageHeader *validate(const char *data, size_t size)
+		{
+			const YAMLImageHeader *header =
+				reinterpret_cast<const YAMLImageHeader*>(data);
+			if (size < sizeof(YAMLImageHeader) ||
+				memcmp(header->magic, "SipYAML", 8) != 0 ||
+				header->version != Image::Version ||
+				header->charSize != sizeof(CharType) ||
+				header->nodeCount == 0)
+			{
+				return nullptr;
+			}
+			size_t body = size - sizeof(YAMLImageHeader);
+			if (size > Image::MaxSize ||
+				header->nodeCount > body / sizeof(Node) ||
+				header->stringSize != body - header->nodeCount * sizeof(Node)
+				|| header->checksum != Image::checksum(*header,
+				data + sizeof(YAMLImageHeader), header->nodeCount * sizeof(Node)))
+			{
+				return nullptr;
+			}
+			return header;
+		}
+
+		const YAMLImageHeader *_header;
+		File::Mapping _mapping;
+		std::string _buffer;
+	};
+
+	typedef YAMLImageBase<Unicode::CharUTF8> YAMLImageUTF8;
+
+#ifdef SIPYAML_THREADS
+	/*!
+	 *	A parsed file that can no longer be modified. The text and the nodes
+	 *	are owned together and all hashes are computed before it is shared, so
+	 *	any number of threads can traverse it at the same time without locks.
+	**/
+	template <typename Char> struct YAMLSharedDocument
+	{
+		typedef typename Char::CharType CharType;
+
+		/*!
+		 *	Reads and parses the indicated file. Returns an empty pointer if
+		 *	the file could not be read.
+		**/
+		static std::shared_ptr<const YAMLSharedDocument> load(const char *path)
+		{
+			std::shared_ptr<YAMLSharedDocument> shared(new YAMLSharedDocument());
+			if (!File::status(path, &shared->_size, &shared->_time) ||
+				!File::read(path, &shared->_text))
+			{
+				return nullptr;
+			}
+			shared->_document->parse(shared->_text.data());
+			shared->_document->hash();
+			return shared;
+		}
+
+		/*!
+		 *	Returns the document.
+		**/
+		inline const YAMLDocumentBase<Char> &document() const
+		{
+			return *_document;
+		}
+
+		/*!
+		 *	Returns the size of the file when it was read, in bytes.
+		**/
+		inline uint64_t size() const
+		{
+			return _size;
+		}
+
+		/*!
+		 *	Returns the modification time of the file when it was read.
+		**/
+		inline int64_t time() const
+		{
+			return _time;
+		}
+
+	private:
+		YAMLSharedDocument() : _document(new YAMLDocumentBase<Char>()),
+			_size(0), _time(0) {}
+
+		std::vector<CharType> _text;
+		std::unique_ptr<YAMLDocumentBase<Char>> _document;
+		uint64_t _size;
+		int64_t _time;
+	};
+
+	/*!
+	 *	A cache of shared documents keyed by file path. Each file is parsed once
+	 *	no matter how many threads request it. When watching, a background
+	 *	thread checks the modification time of every cached file and parses
+	 *	changed files into new documents, which are published atomically.
+	 *	Threads holding the previous version keep using it until they release
+	 *	their handle.
+	**/
+	template <typename Char> struct YAMLCacheBase
+	{
+		typedef YAMLSharedDocument<Char> Document;
+		typedef std::shared_ptr<const Document> Handle;
+
+		YAMLCacheBase() : _watching(false) {}
+
+		/*!
+		 *	Stops watching.
+		**/
+		~YAMLCacheBase()
+		{
+			stop();
+		}
+
+		/*!
+		 *	Returns the cache shared by the whole process.
+		**/
+		static YAMLCacheBase &global()
+		{
+			static YAMLCacheBase cache;
+			return cache;
+		}
+
+		/*!
+		 *	Returns the latest version of the indicated file, parsing it if it
+		 *	has not been requested before. Returns an empty handle if the file
+		 *	could not be read.
+		**/
+		Handle get(const std::string &path)
+		{
+			std::shared_ptr<Entry> entry = find(path);
+			Handle handle = std::atomic_load(&entry->current);
+			if (!handle)
+			{
+				update(entry.get(), path);
+				handle = std::atomic_load(&entry->current);
+			}
+			return handle;
+		}
+
+		/*!
+		 *	Parses every cached file whose size or modification time changed.
+		 *	Files that can no longer be read keep their last version.
+		**/
+		void refresh()
+		{
+			std::vector<std::pair<std::string, std::shared_ptr<Entry>>> entries;
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				entries.assign(_entries.begin(), _entries.end());
+			}
+			for (size_t i = 0; i != entries.size(); ++i)
+			{
+				update(entries[i].second.get(), entries[i].first);
+			}
+		}
+
+		/*!
+		 *	Starts a background thread that calls refresh() at the indicated
+		 *	interval. Does nothing if the cache is already watching.
+		**/
+		void watch(std::chrono::milliseconds interval)
+		{
+			std::lock_guard<std::mutex> lock(_wakeMutex);
+			if (_watching)
+			{
+				return;
+			}
+			_watching = true;
+			_thread = std::thread([this, interval]()
+			{
+				std::unique_lock<std::mutex> wakeLock(_wakeMutex);
+				while (!_wake.wait_for(wakeLock, interval,
+					[this]() { return !_watching; }))
+				{
+					wakeLock.unlock();
+					refresh();
+					wakeLock.lock();
+				}
+			});
+		}
+
+		/*!
+		 *	Stops the background thread, if it is running.
+		**/
+		void stop()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_wakeMutex);
+				_watching = false;
+			}
+			_wake.notify_all();
+			if (_thread.joinable())
+			{
+				_thread.join();
+			}
+		}
+
+	private:
+		YAMLCacheBase(const YAMLCacheBase &);
+		YAMLCacheBase &operator=(const YAMLCacheBase &);
+
+		struct Entry
+		{
+			std::mutex loading;		// Held while the file is being parsed.
+			Handle current;			// Only accessed atomically.
+		};
+
+		std::shared_ptr<Entry> find(const std::string &path)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			std::shared_ptr<Entry> &entry = _entries[path];
+			if (!entry)
+			{
+				entry = std::make_shared<Entry>();
+			}
+			return entry;
+		}
+
+		static void update(Entry *entry, const std::string &path)
+		{
+			std::lock_guard<std::mutex> lock(entry->loading);
+			Handle current = std::atomic_load(&entry->current);
+			uint64_t size;
+			int64_t time;
+			if (!File::status(path.c_str(), &size, &time) ||
+				(current && current->size() == size && current->time() == time))
+			{
+				return;
+			}
+			Handle next = Document::load(path.c_str());
+			if (next)
+			{
+				std::atomic_store(&entry->current, next);
+			}
+		}
+
+		std::mutex _mutex;			// Guards _entries.
+		std::unordered_map<std::string, std::shared_ptr<Entry>> _entries;
+		std::mutex _wakeMutex;		// Guards _watching.
+		std::condition_variable _wake;
+		std::thread _thread;
+		bool _watching;
+	};
+
+	typedef YAMLCacheBase<Unicode::CharUTF8> YAMLCacheUTF8;
+#endif // SIPYAML_THREADS
+#endif // SIPYAML_MMAP
+
+#ifdef SIPYAML_THREADS
+	/*!
+	 *	Keeps ready to use documents on the heap, so that servers can parse many
+	 *	small files without constructing a document, or placing its static
+	 *	memory pool on the stack, for each one. Every thread returns documents
+	 *	to its own free list, and takes documents from other lists when its own
+	 *	is empty. The pool must outlive every handle it returns.
+	**/
+	template <typename Char> struct YAMLDocumentPoolBase
+	{
+		typedef YAMLDocumentBase<Char> Document;
+
+		/*!
+		 *	Returns a document to its pool when a handle is destroyed.
+		**/
+		struct Release
+		{
+			YAMLDocumentPoolBase *pool;
+
+			void operator()(Document *document) const
 			{
-				if (Char::isChar(yaml[position], '\0'))
+				pool->release(document);
+			}
+		};
+
+		typedef std::unique_ptr<Document, Release> Handle;
+
+		/*!
+		 *	Creates a pool with the indicated number of free lists, or one per
+		 *	hardware thread if 0. Each list keeps at most capacity documents;
+		 *	any more are deleted when returned.
+		**/
+		explicit YAMLDocumentPoolBase(size_t lists = 0, size_t capacity = 64) :
+			_capacity(capacity)
+		{
+			if (!lists)
+			{
+				lists = std::thread::hardware_concurrency();
+				lists = lists ? lists : 1;
+			}
+			for (size_t i = 0; i != lists; ++i)
+			{
+				_lists.push_back(std::unique_ptr<List>(new List()));
+			}
+		}
+
+		/*!
+		 *	Deletes every document that has been returned.
+		**/
+		~YAMLDocumentPoolBase()
+		{
+			for (size_t i = 0; i != _lists.size(); ++i)
+			{
+				for (size_t j = 0; j != _lists[i]->free.size(); ++j)
 				{
-					break;
+					delete _lists[i]->free[j];
 				}
-				node = nullptr;
-				indent = 0;
-				while (Char::isChar(yaml[position], ' '))
+			}
+		}
+
+		/*!
+		 *	Returns an empty document, which goes back to the pool when the
+		 *	handle is destroyed.
+		**/
+		Handle checkout()
+		{
+			size_t first = list();
+			Document *document = take(_lists[first].get(), false);
+			for (size_t i = 1; !document && i != _lists.size(); ++i)
+			{
+				document = take(_lists[(first + i) % _lists.size()].get(),
+					true);
+			}
+			if (!document)
+			{
+				document = new Document();
+			}
+			Release release = {this};
+			return Handle(document, release);
+		}
+
+		/*!
+		 *	Adds documents to the free list of the calling thread.
+		**/
+		void reserve(size_t count)
+		{
+			List *mine = _lists[list()].get();
+			std::lock_guard<std::mutex> lock(mine->mutex);
+			for (size_t i = 0; i != count && mine->free.size() < _capacity;
+				++i)
+			{
+				mine->free.push_back(new Document());
+			}
+		}
+
+	private:
+		YAMLDocumentPoolBase(const YAMLDocumentPoolBase &);
+		YAMLDocumentPoolBase &operator=(const YAMLDocumentPoolBase &);
+
+		struct List
+		{
+			std::mutex mutex;
+			std::vector<Document*> free;
+		};
+
+		/*!
+		 *	Returns the index of the free list owned by the calling thread.
+		**/
+		size_t list() const
+		{
+			static std::atomic<size_t> next(0);
+			static thread_local size_t index = next++;
+			return index % _lists.size();
+		}
+
+		/*!
+		 *	Takes a document from the indicated list. When stealing, busy
+		 *	lists are skipped rather than waited for.
+		**/
+		static Document *take(List *list, bool steal)
+		{
+			std::unique_lock<std::mutex> lock(list->mutex, std::defer_lock);
+			if (!steal)
+			{
+				lock.lock();
+			}
+			else if (!lock.try_lock())
+			{
+				return nullptr;
+			}
+			if (list->free.empty())
+			{
+				return nullptr;
+			}
+			Document *document = list->free.back();
+			list->free.pop_back();
+			return document;
+		}
+
+		void release(Document *document)
+		{
+			document->reset();
+			List *mine = _lists[list()].get();
+			{
+				std::lock_guard<std::mutex> lock(mine->mutex);
+				if (mine->free.size() < _capacity)
 				{
-					indent += 1;
-					++position;
+					mine->free.push_back(document);
+					return;
 				}
+			}
+			delete document;
+		}
 
-				if (Char::isChar(yaml[position], '-'))
+		std::vector<std::unique_ptr<List>> _lists;
+		size_t _capacity;
+	};
+
+	typedef YAMLDocumentPoolBase<Unicode::CharUTF8> YAMLDocumentPoolUTF8;
+
+	/*!
+	 *	A document that is parsed while it is read from a stream that cannot be
+	 *	memory mapped, such as a pipe. A reader thread fills a ring of chunks
+	 *	while the calling thread parses the chunks already read, so loading
+	 *	takes about as long as the slower of the two. Node strings point into
+	 *	the chunks, which the base document keeps until it is reset, parsed
+	 *	again in full or destroyed.
+	**/
+	template <typename Char> struct YAMLStreamDocumentBase :
+		public YAMLDocumentBase<Char>
+	{
+		typedef typename Char::CharType CharType;
+
+		/*!
+		 *	Reads and parses the indicated file, adding its nodes to the
+		 *	document. chunkSize is the number of characters read at a time,
+		 *	and ringSize is the number of chunks that may be read ahead of
+		 *	the parser. Returns false if the file could not be read.
+		**/
+		bool load(std::FILE *file, size_t chunkSize = 256 * 1024,
+			size_t ringSize = 4)
+		{
+			Ring ring(ringSize ? ringSize : 1);
+			Reader reader(file, &ring, chunkSize ? chunkSize : 1);
+			typename YAMLDocumentBase<Char>::ParseState state(this, 0);
+			const CharType *carry = nullptr;
+			size_t carrySize = 0;
+			while (1)
+			{
+				Chunk chunk;
+				bool end;
 				{
-					if (Char::isChar(yaml[position + 1], '-') &&
-						Char::isChar(yaml[position + 2], '-'))
-					{
-						node = allocateNode(Sip::Begin);
-						position += 3;
-					}
-					else if (Char::isChar(yaml[position + 1], ' '))
-					{
-						// Read key/value.
-						node = allocateNode(Sip::Sequence, 0, 0,
-							&yaml[++position]);
-						while (notEndKey(&yaml[++position])) {}
-						// TODO: Check key size.
-						if (isKeyChar(&yaml[position]))
-						{
-							// Both scalar and key.
-							node->setKey(node->value(),
-								&yaml[position] - node->value() - 1);
-							node->setValue(&yaml[position], 0);
-							while (notEnd(yaml[++position])) {}
-							// TODO: Check value size.
-							node->setValue(node->value(),
-								&yaml[position] - node->value());
-						}
-						else
-						{
-							// Only scalar, no key.
-							node->setValue(node->value(),
-								&yaml[position] - node->value());
-						}
-					}
-					else
+					std::unique_lock<std::mutex> lock(ring.mutex);
+					while (ring.head == ring.tail)
 					{
-						// TODO: This should go parse maps.
+						ring.changed.wait(lock);
 					}
+					chunk = std::move(ring.chunks[ring.head % ring.chunks.size()]);
+					++ring.head;
+					end = ring.done && ring.head == ring.tail;
+					ring.changed.notify_all();
 				}
-				else if (Char::isChar(yaml[position], '.') &&
-					Char::isChar(yaml[position + 1], '.') &&
-					Char::isChar(yaml[position + 2], '.'))
+
+				// Put the unfinished line of the last chunk in front.
+				CharType *text = chunk.data.get() + Headroom;
+				if (carrySize > Headroom)
 				{
-					node = allocateNode(Sip::End);
-					position += 3;
+					std::unique_ptr<CharType[]> data(
+						new CharType[carrySize + chunk.size + 1]);
+					memcpy(data.get() + carrySize, text,
+						chunk.size * sizeof(CharType));
+					chunk.data = std::move(data);
+					text = chunk.data.get() + carrySize;
 				}
-				else if (!Char::isChar(yaml[position], '#'))
+				text -= carrySize;
+				if (carrySize)
 				{
-					// Map Elements processing.
-					node = allocateNode(Sip::Mapping, &yaml[position], 0);
-					while (notEndKey(&yaml[++position])) {}
-					if (!isKeyChar(&yaml[position]))
-					{
-						cout << "ERROR!";
-						// TODO: Error, expected key.
-					}
-					node->setKey(node->key(),
-						&yaml[position] - node->key() - 1);
-					while (isWhitespace(yaml[++position])) {}
-					node->setValue(&yaml[position], 0);
-					while (notEnd(yaml[++position])) {}
-					node->setValue(node->value(),
-						&yaml[position] - node->value());
+					memcpy(text, carry, carrySize * sizeof(CharType));
 				}
-				
-				// Checks for comment. Otherwise, skips newline.
-				if (Char::isChar(yaml[position++], '#'))
+				size_t size = carrySize + chunk.size;
+				this->keepText(std::move(chunk.data));
+				if (end)
 				{
-					YAMLNode<Char> *commentNode =
-						allocateNode(Sip::Comment, 0, 0, &yaml[position]);
-					while (!Char::isChar(yaml[position], '\n') &&
-							yaml[position] != 0)
-					{
-						++position;
-					}
-					commentNode->setValue(commentNode->value(),
-						&yaml[position] - commentNode->value());
-					if (node)
-					{
-						//node->setType(Sip::Inline);
-						node->appendNode(commentNode);
-					}
-					else
-					{
-						node = commentNode;
-					}
-					++position;
+					text[size] = 0;
+					this->parseLines(text, 0, static_cast<size_t>(-1), &state);
+					break;
 				}
 
-				// Add new parent.
-				if (indent == indents.top())
-				{
-					inserting->appendNode(node);
-				}
-				else if (indent > indents.top())
+				// Parse up to the last complete line. The character after it
+				// is replaced while parsing, so scans cannot run past it.
+				size_t last = size;
+				while (last && !Char::isChar(text[last - 1], '\n'))
 				{
-					inserting = inserting->lastChild();
-					inserting->appendNode(node);
-					indents.push(indent);
+					--last;
 				}
-				else
+				if (last)
 				{
-					while (indent < indents.top())
-					{
-						inserting = inserting->parent();
-						indents.pop();
-					}
-					if (indent != indents.top())
-					{
-						// TODO: Error, wrong indent level.
-					}
-					inserting->appendNode(node);
+					CharType next = text[last];
+					text[last] = 0;
+					this->parseLines(text, 0, last - 1, &state);
+					this->breakText(&state);
+					text[last] = next;
 				}
-				node = nullptr;
+				carry = text + last;
+				carrySize = size - last;
 			}
+			return !ring.failed;
 		}
-	private:
-		
-		static inline bool notEnd(const CharType ch)
+
+		/*!
+		 *	Reads and parses the file at the indicated path. Returns false if
+		 *	it could not be read.
+		**/
+		bool load(const char *path, size_t chunkSize = 256 * 1024,
+			size_t ringSize = 4)
 		{
-			return !(Char::isChar(ch, '\0') || Char::isChar(ch, '\n') ||
-					Char::isChar(ch, '#'));
+			std::FILE *file = std::fopen(path, "rb");
+			if (!file)
+			{
+				return false;
+			}
+			bool loaded = load(file, chunkSize, ringSize);
+			std::fclose(file);
+			return loaded;
 		}
-		
-		static inline bool isKeyChar(const CharType *ch)
+
+	private:
+
+		// Characters kept free in front of each chunk for the end of the
+		// previous chunk. Longer lines are copied into a new chunk.
+		static const size_t Headroom = 1024;
+
+		struct Chunk
 		{
-			return (Char::isChar(*ch, ' ') && Char::isChar(*(ch - 1), ':'));
-		}
-		
-		static inline bool notEndKey(const CharType *ch)
+			Chunk() : size(0) {}
+
+			std::unique_ptr<CharType[]> data;
+			size_t size;
+		};
+
+		/*!
+		 *	Chunks read but not yet parsed. head and tail count the chunks
+		 *	taken and added so far.
+		**/
+		struct Ring
 		{
-			return notEnd(*ch) && !isKeyChar(ch);
-		}
-		
-		static inline bool isWhitespace(const CharType ch)
+			explicit Ring(size_t size) : chunks(size), head(0), tail(0),
+				done(false), failed(false), stopped(false) {}
+
+			std::mutex mutex;
+			std::condition_variable changed;
+			std::vector<Chunk> chunks;
+			size_t head;
+			size_t tail;
+			bool done;
+			bool failed;
+			bool stopped;			// The parser left, so stop reading.
+		};
+
+		/*!
+		 *	Runs read() on its own thread, and stops and joins it when
+		 *	destroyed, including when parsing throws.
+		**/
+		struct Reader
 		{
-			return Char::isChar(ch, ' ') || Char::isChar(ch, '\t');
+			Reader(std::FILE *file, Ring *ring, size_t chunkSize) :
+				_ring(ring), _thread(&YAMLStreamDocumentBase::read, file, ring,
+				chunkSize) {}
+
+			~Reader()
+			{
+				{
+					std::lock_guard<std::mutex> lock(_ring->mutex);
+					_ring->stopped = true;
+					_ring->changed.notify_all();
+				}
+				_thread.join();
+			}
+
+		private:
+
+			Reader(const Reader &);
+			Reader &operator=(const Reader &);
+
+			Ring *_ring;
+			std::thread _thread;
+		};
+
+		/*!
+		 *	Reads chunks until the end of the file, waiting while the ring is
+		 *	full. Each chunk has room for the previous chunk's unfinished line
+		 *	in front and a terminator behind.
+		**/
+		static void read(std::FILE *file, Ring *ring, size_t chunkSize)
+		{
+			bool end = false;
+			while (!end)
+			{
+				Chunk chunk;
+				chunk.data.reset(new CharType[Headroom + chunkSize + 1]);
+				chunk.size = std::fread(chunk.data.get() + Headroom,
+					sizeof(CharType), chunkSize, file);
+				end = chunk.size != chunkSize;
+
+				std::unique_lock<std::mutex> lock(ring->mutex);
+				while (ring->tail - ring->head == ring->chunks.size() &&
+					!ring->stopped)
+				{
+					ring->changed.wait(lock);
+				}
+				if (ring->stopped)
+				{
+					return;
+				}
+				ring->chunks[ring->tail % ring->chunks.size()] = std::move(chunk);
+				++ring->tail;
+				if (end)
+				{
+					ring->done = true;
+					ring->failed = std::ferror(file) != 0;
+				}
+				ring->changed.notify_all();
+			}
 		}
 	};
 
-	struct YAMLDocumentUTF8 : public YAMLDocumentBase<Unicode::CharUTF8> {};
-	struct YAMLDocumentUTF16 : public YAMLDocumentBase<Unicode::CharUTF8> {};
-#ifndef SIPYAML_BIG_ENDIAN
-	typedef YAMLDocumentUTF16 YAMLDocumentUTF16LE;
-	struct YAMLDocumentUTF16BE :
-		public YAMLDocumentBase<Unicode::CharUTF16Inverse> {};
-#else
-	typedef YAMLDocumentUTF16 YAMLDocumentUTF16BE;
-	struct YAMLDocumentUTF16LE :
-		public YAMLDocumentBase<Unicode::CharUTF16Inverse> {};
-#endif
+	typedef YAMLStreamDocumentBase<Unicode::CharUTF8> YAMLStreamDocumentUTF8;
+#endif // SIPYAML_THREADS
 }
 
 #endif // SIPYAML__H_eTNcyHjx
\ No newline at end of file
@@ -0,0 +1,697 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "SipYAML.hpp"
+using std::cout;
+using std::endl;
+
+typedef Sip::YAMLDocumentUTF8 Document;
+typedef Document::Node Node;
+
+const char *lines[] =
+{
+	"a: 1", "b: 2", "  c: 3", "  d: 4 # x", "    e: 5", "  - f", "  - g: 6",
+	"#comment", "h: 7", "    i: 8", "---", "..."
+};
+const size_t lineCount = sizeof(lines) / sizeof(lines[0]);
+
+size_t failures = 0;
+
+void check(bool passed, const char *name, const std::string &detail = "")
+{
+	if (!passed)
+	{
+		++failures;
+		cout << "FAILED: " << name << endl << detail << endl;
+	}
+}
+
+/*!
+ *	Appends every node's type, string offsets and sizes, so two documents
+ *	parsed from the same text compare equal only if they are identical.
+**/
+void describe(std::string *out, const Sip::NodeBase<Node> *root,
+	const char *text)
+{
+	Sip::PreOrderIterator<Node> node(root), end;
+	for (; node != end; ++node)
+	{
+		out->append(node.depth(), ' ');
+		out->append(std::to_string(node->type()));
+		const char *strings[] = {node->key(), node->value(), node->line()};
+		size_t sizes[] = {node->keySize(), node->valueSize(),
+			node->lineSize()};
+		for (size_t i = 0; i != 3; ++i)
+		{
+			out->append(strings[i] ? " " + std::to_string(strings[i] - text) :
+				" -");
+			out->append("/" + std::to_string(sizes[i]));
+		}
+		out->append(1, '\n');
+	}
+}
+
+/*!
+ *	Appends every node's depth, type, key and value without surrounding
+ *	blanks, so a document and the parse of its printed text compare equal
+ *	if they hold the same data.
+**/
+void outline(std::string *out, const Sip::NodeBase<Node> *root)
+{
+	Sip::PreOrderIterator<Node> node(root), end;
+	for (; node != end; ++node)
+	{
+		out->append(node.depth(), ' ');
+		out->append(std::to_string(node->type()));
+		const char *strings[] = {node->key(), node->value()};
+		size_t sizes[] = {node->keySize(), node->valueSize()};
+		for (size_t i = 0; i != 2; ++i)
+		{
+			Sip::Unicode::String<char> string =
+				Sip::Unicode::trim<Sip::Unicode::CharUTF8>(strings[i], sizes[i]);
+			out->append(" [");
+			out->append(string.data, string.size);
+			out->append("]");
+		}
+		out->append(1, '\n');
+	}
+}
+
+/*!
+ *	Returns whether every line has a form the parser handles, so the full
+ *	parse it is compared against is meaningful.
+**/
+bool parsable(const std::string &text)
+{
+	size_t position = 0;
+	while (position < text.size())
+	{
+		size_t end = text.find('\n', position);
+		end = end == std::string::npos ? text.size() : end;
+		std::string line = text.substr(position, end - position);
+		size_t indent = line.find_first_not_of(' ');
+		if (indent == std::string::npos || (!position && indent) ||
+			line[line.size() - 1] == ':')
+		{
+			return false;
+		}
+		std::string rest = line.substr(indent);
+		bool marker = rest == "---" || rest == "...";
+		if ((rest[0] == '-' && !marker && rest.compare(0, 2, "- ")) ||
+			(rest[0] == '.' && !marker))
+		{
+			return false;
+		}
+		if (!marker && rest[0] != '#' && rest[0] != '-' &&
+			line.find(": ") == std::string::npos)
+		{
+			return false;
+		}
+		position = end + 1;
+	}
+	return true;
+}
+
+/*!
+ *	Applies random edits to random documents, in place and into new buffers,
+ *	and compares reparse() against parsing the edited text from scratch.
+**/
+void testReparse()
+{
+	srand(1);
+	size_t edits = 0;
+	for (size_t iteration = 0; iteration != 2000; ++iteration)
+	{
+		std::string text = "r: 0\n";
+		for (int i = rand() % 12; i; --i)
+		{
+			text += lines[rand() % lineCount];
+			text += '\n';
+		}
+		std::vector<char> buffer(text.begin(), text.end());
+		buffer.reserve(4096);
+		buffer.push_back(0);
+		Document document;
+		document.parse(buffer.data());
+		for (size_t edit = 0; edit != 5; ++edit)
+		{
+			size_t size = buffer.size() - 1;
+			size_t offset = rand() % (size + 1);
+			size_t removed = rand() % 4;
+			removed = offset + removed > size ? size - offset : removed;
+			std::string inserted = rand() % 3 ? std::string(
+				lines[rand() % lineCount]) + "\n" : std::string(":");
+			std::vector<char> edited(buffer.begin(), buffer.begin() + offset);
+			edited.insert(edited.end(), inserted.begin(), inserted.end());
+			edited.insert(edited.end(), buffer.begin() + offset + removed,
+				buffer.end());
+			if (!parsable(edited.data()))
+			{
+				break;
+			}
+			if (rand() % 2)
+			{
+				// Same buffer, edited in place.
+				buffer.assign(edited.begin(), edited.end());
+			}
+			else
+			{
+				buffer.swap(edited);
+			}
+
+			document.reparse(buffer.data(), offset, removed,
+				inserted.size());
+			Document reference;
+			reference.parse(buffer.data());
+			std::string reparsed, parsed;
+			describe(&reparsed, &document, buffer.data());
+			describe(&parsed, &reference, buffer.data());
+			check(reparsed == parsed, "reparse matches a full parse",
+				buffer.data());
+			++edits;
+		}
+	}
+	cout << "reparse: " << edits << " edits" << endl;
+}
+
+/*!
+ *	Checks the printed text of a few edits that must keep their layout.
+**/
+void testRoundTripCases()
+{
+	struct Case
+	{
+		const char *yaml;
+		void (*edit)(Document *document);
+		const char *expected;
+	};
+	const Case cases[] =
+	{
+		// A subtree moved to a shallower depth is indented again.
+		{"a: 1\n    b: 2\n        c: 3\nd: 4\n", [](Document *document)
+			{
+				Node *b = document->firstChild()->firstChild();
+				document->firstChild()->removeNode(b);
+				document->appendNode(b);
+			}, "a: 1\nd: 4\nb: 2\n        c: 3\n"},
+		// Nodes that shared a source line stay on it.
+		{"--- # start\na: 1\n", [](Document *document)
+			{
+				document->setValue(document->lastChild(), "2");
+			}, "--- # start\na: 2\n"},
+		{"--- !clarkevans.com/^invoice\na: 1\nb: 2\n", [](Document *document)
+			{
+				document->setValue(document->lastChild(), "3");
+			}, "--- !clarkevans.com/^invoice\na: 1\nb: 3\n"},
+		// Removing one of them does not bring its text back.
+		{"--- # start\na: 1\n", [](Document *document)
+			{
+				document->removeNode(document->firstChild()->nextSibling());
+			}, "---\na: 1\n"}
+	};
+	for (size_t i = 0; i != sizeof(cases) / sizeof(cases[0]); ++i)
+	{
+		std::string text = cases[i].yaml;
+		Document document;
+		document.parse(text.c_str());
+		cases[i].edit(&document);
+		std::string printed;
+		document.printRoundTrip(&printed);
+		check(printed == cases[i].expected, "round trip case", printed);
+	}
+}
+
+/*!
+ *	Returns a random document whose siblings share their indentation and
+ *	whose children are indented further, as YAML requires.
+**/
+std::string nested()
+{
+	const char *contents[] =
+	{
+		"a: 1", "b: 2 # x", "- f", "- g: 6", "#comment", "---", "..."
+	};
+	std::string text = "r: 0\n";
+	size_t depth = 0;
+	bool parent = true;
+	for (int i = rand() % 12; i; --i)
+	{
+		depth = rand() % (depth + (parent ? 2 : 1));
+		std::string content = contents[rand() % 7];
+		parent = content != "---" && content != "...";
+		if (depth && !parent)
+		{
+			content = "c: 3";
+			parent = true;
+		}
+		text.append(depth * 2, ' ');
+		text += content + "\n";
+	}
+	return text;
+}
+
+/*!
+ *	Checks that unchanged documents print as their source, and that after
+ *	random value changes and moves the printed text parses back to the same
+ *	nodes.
+**/
+void testRoundTrip()
+{
+	srand(2);
+	size_t edits = 0;
+	for (size_t iteration = 0; iteration != 2000; ++iteration)
+	{
+		std::string text = nested();
+		Document document;
+		document.parse(text.c_str());
+		std::string printed;
+		document.printRoundTrip(&printed);
+		check(printed == text, "unchanged round trip", text + "\n" + printed);
+
+		std::vector<Node*> nodes;
+		Sip::PreOrderIterator<Node> node(&document), end;
+		for (; node != end; ++node)
+		{
+			size_t type = node->type() & 0xF;
+			if (type == Sip::Mapping || type == Sip::Sequence)
+			{
+				nodes.push_back(&*node);
+			}
+		}
+		for (size_t edit = 0; edit != 3 && !nodes.empty(); ++edit)
+		{
+			Node *target = nodes[rand() % nodes.size()];
+			if (rand() % 2)
+			{
+				document.setValue(target, "v");
+			}
+			else
+			{
+				// Move the node below any node that is not inside it.
+				Sip::NodeBase<Node> *parent = &document;
+				Node *candidate = nodes[rand() % nodes.size()];
+				Node *ancestor = candidate;
+				while (ancestor && ancestor != target)
+				{
+					ancestor = ancestor->parent();
+				}
+				if (!ancestor && rand() % 3)
+				{
+					parent = candidate;
+				}
+				target->parent() ? target->parent()->removeNode(target) :
+					document.removeNode(target);
+				parent->appendNode(target);
+			}
+			std::string expected, reparsed;
+			printed.clear();
+			document.printRoundTrip(&printed);
+			Document reference;
+			reference.parse(printed.c_str());
+			outline(&expected, &document);
+			outline(&reparsed, &reference);
+			check(expected == reparsed, "edited round trip parses back",
+				text + "\n" + printed);
+			++edits;
+		}
+	}
+	cout << "round trip: " << edits << " edits" << endl;
+}
+
+#ifdef SIPYAML_THREADS
+/*!
+ *	Checks that printing on several threads gives the same text as printing
+ *	on one, with and without text already in the printer.
+**/
+void testParallelPrint()
+{
+	srand(3);
+	for (size_t iteration = 0; iteration != 500; ++iteration)
+	{
+		std::string text = nested();
+		Document document;
+		document.parse(text.c_str());
+		Sip::YAMLForwardDocumentUTF8 forward;
+		forward.parse(text.c_str());
+		std::string start = iteration % 2 ? "x" : "";
+		std::string serial = start;
+		document.print(&serial);
+		for (size_t threads = 1; threads != 5; ++threads)
+		{
+			std::string parallel = start, forwardParallel = start;
+			document.print(&parallel, threads);
+			forward.print(&forwardParallel, threads);
+			check(parallel == serial && forwardParallel == serial,
+				"parallel print matches serial print", text);
+		}
+	}
+}
+#endif // SIPYAML_THREADS
+
+/*!
+ *	Checks that parsing more text into a hashed document drops its cached
+ *	hash, and that the two texts are not printed as one piece.
+**/
+void testParseAfterHash()
+{
+	Document document;
+	document.parse("a: 1\n");
+	uint64_t hash = document.hash();
+	document.parse("b: 2\n");
+	Document reference;
+	reference.parse("a: 1\nb: 2\n");
+	check(document.hash() != hash && document.hash() == reference.hash(),
+		"parsing into a hashed document updates its hash");
+	std::string printed;
+	document.printRoundTrip(&printed);
+	check(printed == "a: 1\nb: 2\n", "round trip of two parsed texts",
+		printed);
+}
+
+#ifdef SIPYAML_THREADS
+/*!
+ *	Checks that a stream document parses like a plain one across small
+ *	chunks, and that resetting it through the base document empties it.
+**/
+void testStream()
+{
+	std::string text;
+	for (size_t i = 0; i != 200; ++i)
+	{
+		text += "key" + std::to_string(i) + ": value\n  - item " +
+			std::to_string(i) + "\n";
+	}
+	std::FILE *file = std::tmpfile();
+	std::fwrite(text.data(), 1, text.size(), file);
+	std::rewind(file);
+	Sip::YAMLStreamDocumentUTF8 stream;
+	bool loaded = stream.load(file, 16, 2);
+	std::fclose(file);
+	Document document;
+	document.parse(text.c_str());
+	std::string streamed, parsed;
+	stream.print(&streamed);
+	document.print(&parsed);
+	check(loaded && streamed == parsed, "stream document parses in chunks",
+		streamed);
+
+	Sip::YAMLDocumentBase<Sip::Unicode::CharUTF8> &base = stream;
+	base.reset();
+	base.parse("a: 1\n");
+	streamed.clear();
+	stream.print(&streamed);
+	check(streamed == "a: 1", "stream document resets through its base",
+		streamed);
+}
+
+/*!
+ *	Checks that a pooled document comes back like a new one, with keys
+ *	copied rather than interned and no nodes or strings left over.
+**/
+void testPool()
+{
+	Sip::YAMLDocumentPoolUTF8 pool(1);
+	{
+		Sip::YAMLDocumentPoolUTF8::Handle document = pool.checkout();
+		document->setInternKeys(true);
+		document->parse("a: 1\n");
+		document->internString("key", 3);
+	}
+	Sip::YAMLDocumentPoolUTF8::Handle document = pool.checkout();
+	Node *first = document->allocateNode(Sip::Mapping);
+	Node *second = document->allocateNode(Sip::Mapping);
+	document->setKey(first, "key");
+	document->setKey(second, "key");
+	check(!document->firstChild() && first->key() != second->key(),
+		"pooled documents come back with new settings");
+	const char *again = document->internString("key", 3);
+	check(document->internString("key", 3) == again &&
+		std::string(again, 3) == "key", "pooled documents intern again");
+}
+#endif
+
+/*!
+ *	Checks parseReal() against strtod() on random strings of number
+ *	characters. strtod() reading all of a string as a finite number must
+ *	agree exactly; out of range results may go either way.
+**/
+void testParseReal()
+{
+	const char alphabet[] = "0123456789012345678901234567890123456789.eE+-";
+	srand(11);
+	size_t mismatches = 0;
+	std::string first;
+	for (size_t i = 0; i != 200000; ++i)
+	{
+		std::string text;
+		size_t size = 1 + rand() % 30;
+		for (size_t j = 0; j != size; ++j)
+		{
+			text += alphabet[rand() % (sizeof(alphabet) - 1)];
+		}
+		errno = 0;
+		char *end;
+		double expected = std::strtod(text.c_str(), &end);
+		bool range = errno == ERANGE;
+		bool whole = end == text.c_str() + text.size() &&
+			expected - expected == 0;
+		double value = 0;
+		bool parsed = Sip::Number::parseReal(text.data(), text.size(),
+			&value);
+		if (!range && (parsed != whole || (parsed && std::memcmp(&value,
+			&expected, sizeof(value)))))
+		{
+			first = mismatches++ ? first : text;
+		}
+	}
+	check(!mismatches, "parseReal() agrees with strtod()", first);
+}
+
+/*!
+ *	Checks that diff() reports a changed value, an added key and a removed
+ *	key by path, and that equal documents have no differences.
+**/
+void testDiff()
+{
+	typedef Sip::YAMLDiff<Sip::Unicode::CharUTF8> Diff;
+	Document previous, current, same;
+	previous.parse("a: 1\nb: 2\n  c: 3\nd: 4\nf: 7\n");
+	current.parse("a: 1\nb: 2\n  c: 5\ne: 6\nd: 4\n");
+	same.parse("a: 1\nb: 2\n  c: 3\nd: 4\nf: 7\n");
+	const char *names[] = {"Added ", "Removed ", "Changed "};
+	std::vector<Diff::Difference> differences;
+	Diff::diff(&previous, &current, &differences);
+	std::string found;
+	for (size_t i = 0; i != differences.size(); ++i)
+	{
+		found += names[differences[i].change];
+		Diff::printPath(&found, differences[i].current ?
+			differences[i].current : differences[i].previous);
+		found += "\n";
+	}
+	check(found == "Added e\nRemoved f\nChanged b/c\n",
+		"diff() reports changes by path", found);
+	differences.clear();
+	Diff::diff(&previous, &same, &differences);
+	check(differences.empty() && previous.hash() == same.hash(),
+		"equal documents have no differences");
+}
+
+/*!
+ *	Checks the order and depths of the pre-order and post-order iterators,
+ *	and that skipChildren() leaves out only the current node's children.
+**/
+void testIterators()
+{
+	Document document;
+	document.parse("a: 1\n  b: 2\n    c: 3\n  d: 4\ne: 5\n");
+	std::string pre, post, skipped;
+	Sip::PreOrderIterator<Node> node(&document), end;
+	for (; node != end; ++node)
+	{
+		pre += std::string(node->key(), node->keySize()) +
+			std::to_string(node.depth());
+	}
+	Sip::PostOrderIterator<Node> last(&document), stop;
+	for (; last != stop; ++last)
+	{
+		post += std::string(last->key(), last->keySize()) +
+			std::to_string(last.depth());
+	}
+	for (node = Sip::PreOrderIterator<Node>(&document); node != end;)
+	{
+		skipped += std::string(node->key(), node->keySize());
+		if (Sip::Unicode::CharUTF8::isChar(*node->key(), 'b'))
+		{
+			node.skipChildren();
+		}
+		else
+		{
+			++node;
+		}
+	}
+	Document empty;
+	check(pre == "a0b1c2d1e0" && post == "c2b1d1a0e0" && skipped == "abde",
+		"pre-order and post-order iterators", pre + " " + post + " " +
+		skipped);
+	check(Sip::PreOrderIterator<Node>(&empty) == end &&
+		Sip::PostOrderIterator<Node>(&empty) == stop,
+		"iterators over an empty document");
+}
+
+/*!
+ *	Checks that copied strings outlive their source, that equal interned
+ *	strings share one copy, and that empty strings share one string.
+**/
+void testStrings()
+{
+	Document document;
+	std::string source = "value";
+	const char *copy = document.copyString(source.data(), source.size());
+	const char *interned = document.internString(source.data(),
+		source.size());
+	source = "other";
+	check(copy != source.data() && std::string(copy, 5) == "value" &&
+		copy != interned && std::string(interned, 5) == "value",
+		"copied strings belong to the document");
+	check(document.internString("value", 5) == interned &&
+		document.internString("other", 5) != interned,
+		"equal interned strings share one copy");
+
+	Document empty;
+	const char *first = empty.copyString("", 0);
+	check(first && empty.copyString("x", 0) == first &&
+		document.copyString("", 0) == first &&
+		empty.internString("", 0) == first, "empty strings are shared");
+}
+
+/*!
+ *	Checks that the topmost layer provides values and sequences, that
+ *	mapping children of every layer are merged, and that keys keep the
+ *	order of the lowest layer that has them.
+**/
+void testOverlay()
+{
+	Document base, top;
+	base.parse("a: 1\nb: 0\n  c: 2\n  d: 3\nlist: 0\n  - x\n  - y\n");
+	top.parse("b: 4\n  c: 9\ne: 5\nlist: 6\n  - z\n");
+	Sip::YAMLOverlayUTF8 overlay;
+	overlay.addLayer(&base);
+	overlay.addLayer(&top);
+	auto value = [&](const char *path)
+	{
+		const Sip::YAMLOverlayUTF8::Entry *entry = overlay.find(path);
+		return entry ? std::string(entry->node()->value(),
+			entry->node()->valueSize()) : std::string("none");
+	};
+	std::string found = value("a") + value("b") + value("b/c") +
+		value("b/d") + value("e") + value("missing") + value("b/x");
+	std::string order, list;
+	const std::vector<const Sip::YAMLOverlayUTF8::Entry*> &children =
+		overlay.children(overlay.root());
+	for (size_t i = 0; i != children.size(); ++i)
+	{
+		order += std::string(children[i]->node()->key(),
+			children[i]->node()->keySize());
+	}
+	const Sip::YAMLOverlayUTF8::Entry *entries = overlay.find("list");
+	for (size_t i = 0; entries && i != overlay.children(entries).size(); ++i)
+	{
+		const Node *node = overlay.children(entries)[i]->node();
+		Sip::Unicode::String<char> entry = Sip::Unicode::trim<
+			Sip::Unicode::CharUTF8>(node->value(), node->valueSize());
+		list += std::string(entry.data, entry.size);
+	}
+	check(found == "14935nonenone" && order == "abliste" && list == "z",
+		"overlay merge precedence", found + " " + order + " " + list);
+}
+
+/*!
+ *	Checks that the writer's comments match printRoundTrip() of the
+ *	equivalent document, and that print() leaves them out.
+**/
+void testWriterComments()
+{
+	std::string written;
+	{
+		Sip::YAMLWriterUTF8 writer(&written);
+		writer.comment("hi");
+		writer.key("a");
+		writer.scalar("1");
+		writer.beginMapping();
+		writer.comment("there");
+		writer.key("b");
+		writer.scalar("2");
+		writer.end();
+	}
+	Document document;
+	Node *comment = document.allocateNode(Sip::Comment);
+	comment->setValue("hi", 2);
+	document.appendNode(comment);
+	Node *mapping = document.allocateNode(Sip::Mapping);
+	mapping->setKey("a", 1);
+	mapping->setValue("1", 1);
+	document.appendNode(mapping);
+	Node *nested = document.allocateNode(Sip::Comment);
+	nested->setValue("there", 5);
+	mapping->appendNode(nested);
+	Node *child = document.allocateNode(Sip::Mapping);
+	child->setKey("b", 1);
+	child->setValue("2", 1);
+	mapping->appendNode(child);
+	std::string printed, plain;
+	document.printRoundTrip(&printed);
+	document.print(&plain);
+	check(written == "# hi\na: 1\n  # there\n  b: 2" && printed == written,
+		"writer comments match the document", written + "\n" + printed);
+	check(plain == "a: 1\n  b: 2", "print() leaves comments out", plain);
+}
+
+/*!
+ *	Checks that the sample file, which does not end in a newline, prints
+ *	back byte for byte.
+**/
+void testSample(const char *path)
+{
+	std::ifstream file(path, std::ios::binary);
+	std::string text((std::istreambuf_iterator<char>(file)),
+		std::istreambuf_iterator<char>());
+	if (!file || text.empty())
+	{
+		check(false, "reading the sample file", path);
+		return;
+	}
+	Document document;
+	document.parse(text.c_str());
+	std::string printed;
+	document.printRoundTrip(&printed);
+	check(printed == text, "round trip of the sample file", printed);
+}
+
+int main(int argc, char **argv)
+{
+	testReparse();
+	testRoundTripCases();
+	testRoundTrip();
+	testParseAfterHash();
+	testWriterComments();
+	testDiff();
+	testIterators();
+	testStrings();
+	testOverlay();
+	testParseReal();
+#ifdef SIPYAML_THREADS
+	testParallelPrint();
+	testStream();
+	testPool();
+#endif
+	testSample(argc > 1 ? argv[1] : "Sample.txt");
+	cout << (failures ? "FAILED" : "PASSED") << endl;
+	return failures ? 1 : 0;
+}
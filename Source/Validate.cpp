@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "SipYAML.hpp"
+using std::cout;
+using std::endl;
+
+typedef std::chrono::steady_clock Clock;
+
+struct Case
+{
+	const char *yaml;
+	size_t offset;		// Offset of the first invalid byte, or -1.
+};
+
+const size_t Valid = static_cast<size_t>(-1);
+
+const Case cases[] =
+{
+	{"a: 1\nb: h\xC3\xA9llo\n", Valid},
+	{"a: 1\nb: \xE2\x82\xAC \xF0\x9F\x98\x80 # \xE4\xB8\xAD\n", Valid},
+	{"a: 1\nb: x\xC0\xAF\n", 9},				// Overlong encoding.
+	{"a: 1\nb: x\xED\xA0\x80\n", 9},			// Surrogate.
+	{"a: 1\nb: \xF4\x90\x80\x80\n", 8},			// Above U+10FFFF.
+	{"a: 1\nb: \xE2\x82\n", 8},					// Truncated sequence.
+	{"a: 1\nb: 12345678901234\xFF\n", 22},		// Invalid byte in a word.
+	{"k: 0123456789012345678901234567890123456789x\xC3\xA9\xC0\xAF\n", 46},
+	{"k: \xE0\x9F\xBF", 3}						// Truncated at the end.
+};
+
+/*!
+ *	Checks that every malformed case is reported at its first invalid byte.
+**/
+bool testOffsets()
+{
+	bool passed = true;
+	for (size_t i = 0; i != sizeof(cases) / sizeof(cases[0]); ++i)
+	{
+		Sip::YAMLDocumentUTF8 doc;
+		size_t offset = Valid;
+		bool valid = doc.parse(cases[i].yaml, &offset);
+		if (valid != (cases[i].offset == Valid) ||
+			(!valid && offset != cases[i].offset))
+		{
+			cout << "FAILED: case " << i << " reported " << offset << endl;
+			passed = false;
+		}
+	}
+	return passed;
+}
+
+/*!
+ *	Reports the best time of parsing a large document without and with
+ *	validation, to show the overhead of validating in the same pass, and
+ *	of validating the text on its own, which varies less between runs.
+**/
+void benchmark()
+{
+	std::string yaml;
+	for (size_t i = 0; i != 400000; ++i)
+	{
+		yaml += "key" + std::to_string(i) + ": some value text \xC3\xA9 # note\n"
+			"  - item: value number " + std::to_string(i) + "\n";
+	}
+
+	long long plain = -1, validated = -1, alone = -1;
+	for (size_t run = 0; run != 15; ++run)
+	{
+		Clock::time_point before = Clock::now();
+		bool valid = Sip::Unicode::CharUTF8::validate(yaml.data(),
+			yaml.size()) == yaml.size();
+		long long check = std::chrono::duration_cast<
+			std::chrono::microseconds>(Clock::now() - before).count();
+		alone = valid && (alone < 0 || check < alone) ? check : alone;
+
+		Clock::time_point start = Clock::now();
+		{
+			Sip::YAMLDocumentUTF8 doc;
+			doc.parse(yaml.c_str());
+		}
+		Clock::time_point middle = Clock::now();
+		{
+			Sip::YAMLDocumentUTF8 doc;
+			size_t offset;
+			doc.parse(yaml.c_str(), &offset);
+		}
+		Clock::time_point end = Clock::now();
+
+		long long first = std::chrono::duration_cast<
+			std::chrono::microseconds>(middle - start).count();
+		long long second = std::chrono::duration_cast<
+			std::chrono::microseconds>(end - middle).count();
+		plain = plain < 0 ? first : std::min(plain, first);
+		validated = validated < 0 ? second : std::min(validated, second);
+	}
+	cout << yaml.size() / 1000000.0 << " MB: plain " << plain <<
+		" us, validated " << validated << " us (" <<
+		(plain ? 100.0 * (validated - plain) / plain : 0.0) <<
+		"% overhead), validation alone " << alone << " us (" <<
+		(plain ? 100.0 * alone / plain : 0.0) << "%)" << endl;
+}
+
+int main()
+{
+	bool passed = testOffsets();
+	benchmark();
+	cout << (passed ? "PASSED" : "FAILED") << endl;
+	return passed ? 0 : 1;
+}